@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+
+/** Geospatial Data Abstraction Library (GDAL) **/
+#include "gdal.h"       // public (C callable) GDAL entry points
+#include "cpl_conv.h"   // various convenience functions for CPL
+#include "cpl_string.h" // various convenience functions for strings
+
+
+#include "utils/const.h"
+#include "utils/alloc.h"
+#include "utils/dir.h"
+#include "utils/string.h"
+#include "utils/table.h"
+#include "utils/lutfile.h"
+
+
+void usage(char *exe, int exit_code){
+
+  printf("\n");
+  printf("Usage: %s -i index.tif -o output.tif [-l LUT.csv] [-p 1,2,...]\n", exe);
+  printf("  \n");
+  printf("  -i index output of rtm-inversion -R (best LUT row and cost)\n");
+  printf("  -o parameter rasters, followed by the cost, as written by rtm-inversion\n");
+  printf("  -l LUT, by default the raster attribute table of the index is used,\n");
+  printf("   or the LUT referenced in its metadata. The LUT may be compiled\n");
+  printf("  -p comma-separated parameters (1-based) to expand, default: all\n");
+  printf("\n");
+
+  exit(exit_code);
+  return;
+}
+
+typedef struct {
+  char input_path[STRLEN];
+  char output_path[STRLEN];
+  char lut_path[STRLEN];
+  char parameters[STRLEN];
+} args_t;
+
+
+void parse_args(int argc, char *argv[], args_t *args){
+int opt, received_n = 0, expected_n = 2;
+
+  opterr = 0;
+
+  copy_string(args->lut_path,   STRLEN, "NULL");
+  copy_string(args->parameters, STRLEN, "NULL");
+
+  while ((opt = getopt(argc, argv, "i:o:l:p:")) != -1){
+    switch(opt){
+      case 'i':
+        copy_string(args->input_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 'o':
+        copy_string(args->output_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 'l':
+        copy_string(args->lut_path, STRLEN, optarg);
+        break;
+      case 'p':
+        copy_string(args->parameters, STRLEN, optarg);
+        break;
+      case '?':
+        if (isprint(optopt)){
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        usage(argv[0], FAILURE);
+      default:
+        fprintf(stderr, "Error parsing arguments.\n");
+        usage(argv[0], FAILURE);
+    }
+  }
+
+  if (received_n != expected_n) {
+    fprintf(stderr, "missing arguments\n");
+    usage(argv[0], FAILURE);
+  }
+
+  int n_input = argc-optind;
+
+  if (n_input > 0) {
+    fprintf(stderr, "too many parameters specified\n");
+    usage(argv[0], FAILURE);
+  }
+
+  return;
+}
+
+
+// LUT from the raster attribute table of the index band
+table_t read_rat(GDALRasterAttributeTableH rat){
+table_t lut;
+
+
+  lut = allocate_table(GDALRATGetRowCount(rat), GDALRATGetColumnCount(rat), false, false);
+
+  for (int r = 0; r < lut.nrow; r++) {
+    for (int o = 0; o < lut.ncol; o++) lut.data[r][o] = GDALRATGetValueAsDouble(rat, r, o);
+  }
+
+  return lut;
+}
+
+
+// LUT parameters from csv, or a view of a compiled LUT that stays mapped
+table_t read_lut(char *path, lutfile_t *file){
+
+
+  if (!is_lutfile(path)) return read_table(path, false, false);
+
+  *file = open_lutfile(path);
+
+  return lutfile_parameters(file);
+}
+
+
+// selected parameters, 0-based
+int parse_parameters(char *list, int npar, int *select, char *exe){
+char buffer[STRLEN];
+char *ptr = NULL, *saveptr = NULL;
+int n = 0;
+
+
+  if (strcmp(list, "NULL") == 0) {
+    for (n = 0; n < npar; n++) select[n] = n;
+    return n;
+  }
+
+  copy_string(buffer, STRLEN, list);
+
+  for (ptr = strtok_r(buffer, ",", &saveptr); ptr != NULL; ptr = strtok_r(NULL, ",", &saveptr)) {
+    if (n == npar || char_to_int(ptr, &select[n]) == FAILURE || select[n] < 1 || select[n] > npar) {
+      fprintf(stderr, "-p needs up to %d parameters within 1 and %d (%s)\n", npar, npar, list);
+      usage(exe, FAILURE);
+    }
+    select[n++]--;
+  }
+
+  return n;
+}
+
+
+int main ( int argc, char *argv[] ){
+
+
+args_t args;
+GDALDatasetH dataset = NULL, output_dataset = NULL;
+GDALRasterBandH band = NULL, output_band = NULL;
+GDALDriverH output_driver = NULL;
+GDALRasterAttributeTableH rat = NULL;
+char **output_options = NULL;
+table_t lut;
+lutfile_t file;
+int *index = NULL, *cost = NULL, *select = NULL;
+float *output = NULL;
+double geotransformation[6];
+double scale, offset;
+int ncol, nrow, ncell, nselect;
+
+
+  parse_args(argc, argv, &args);
+
+  file.map = NULL;
+
+  GDALAllRegister();
+
+  if ((dataset = GDALOpen(args.input_path, GA_ReadOnly)) == NULL){
+    fprintf(stderr, "could not open %s\n", args.input_path);
+    usage(argv[0], FAILURE);
+  }
+
+  if (GDALGetRasterCount(dataset) != 2) {
+    fprintf(stderr, "%s is no index output of rtm-inversion\n", args.input_path);
+    usage(argv[0], FAILURE);
+  }
+
+  ncol  = GDALGetRasterXSize(dataset);
+  nrow  = GDALGetRasterYSize(dataset);
+  ncell = ncol*nrow;
+
+  alloc((void**)&index, ncell, sizeof(int));
+  alloc((void**)&cost,  ncell, sizeof(int));
+
+  band = GDALGetRasterBand(dataset, 1);
+  if (GDALRasterIO(band, GF_Read, 0, 0, ncol, nrow, index, ncol, nrow, GDT_Int32, 0, 0) == CE_Failure){
+    printf("could not read band %d from %s\n", 1, args.input_path);
+    usage(argv[0], FAILURE);
+  }
+  rat = GDALGetDefaultRAT(band);
+
+  band = GDALGetRasterBand(dataset, 2);
+  if (GDALRasterIO(band, GF_Read, 0, 0, ncol, nrow, cost, ncol, nrow, GDT_Int32, 0, 0) == CE_Failure){
+    printf("could not read band %d from %s\n", 2, args.input_path);
+    usage(argv[0], FAILURE);
+  }
+  scale  = GDALGetRasterScale(band, NULL);
+  offset = GDALGetRasterOffset(band, NULL);
+
+
+  // explicit LUT, attribute table, or LUT referenced in the metadata
+  if (strcmp(args.lut_path, "NULL") != 0) {
+    lut = read_lut(args.lut_path, &file);
+  } else if (rat != NULL && GDALRATGetRowCount(rat) > 0) {
+    lut = read_rat(rat);
+  } else {
+    const char *path = GDALGetMetadataItem(dataset, "LUT", "RTM");
+    if (path == NULL) {
+      fprintf(stderr, "%s has no LUT attached, use -l\n", args.input_path);
+      usage(argv[0], FAILURE);
+    }
+    copy_string(args.lut_path, STRLEN, path);
+    lut = read_lut(args.lut_path, &file);
+  }
+
+  alloc((void**)&select, lut.ncol, sizeof(int));
+  nselect = parse_parameters(args.parameters, lut.ncol, select, argv[0]);
+
+
+  if ((output_driver = GDALGetDriverByName("GTiff")) == NULL) {
+    printf("%s driver not found\n", "GTiff");
+    usage(argv[0], FAILURE);
+  }
+
+  output_options = CSLSetNameValue(output_options, "COMPRESS", "ZSTD");
+  output_options = CSLSetNameValue(output_options, "PREDICTOR", "3");
+  output_options = CSLSetNameValue(output_options, "BIGTIFF", "YES");
+
+  if ((output_dataset = GDALCreate(output_driver, args.output_path, ncol, nrow, nselect+1, GDT_Float32, output_options)) == NULL) {
+    printf("Error creating file %s.\n", args.output_path);
+    usage(argv[0], FAILURE);
+  }
+
+  alloc((void**)&output, ncell, sizeof(float));
+
+  // selected parameters, followed by the cost in an additional band
+  for (int o = 0; o <= nselect; o++) {
+
+    for (int c = 0; c < ncell; c++) {
+
+      if (index[c] < 0) {
+        output[c] = -1.0;
+      } else if (index[c] >= lut.nrow) {
+        fprintf(stderr, "LUT row %d exceeds LUT (%d rows)\n", index[c], lut.nrow);
+        usage(argv[0], FAILURE);
+      } else if (o < nselect) {
+        output[c] = table_get(&lut, index[c], select[o]);
+      } else {
+        output[c] = cost[c]*scale + offset;
+      }
+
+    }
+
+    output_band = GDALGetRasterBand(output_dataset, o+1);
+    GDALSetRasterNoDataValue(output_band, -1.0);
+
+    if (GDALRasterIO(output_band, GF_Write, 0, 0, ncol, nrow,
+      output, ncol, nrow, GDT_Float32, 0, 0) == CE_Failure){
+      printf("Unable to write band %d in %s.\n", o+1, args.output_path);
+      usage(argv[0], FAILURE);
+    }
+
+  }
+
+  GDALGetGeoTransform(dataset, geotransformation);
+  GDALSetGeoTransform(output_dataset, geotransformation);
+  GDALSetProjection(output_dataset, GDALGetProjectionRef(dataset));
+
+  GDALClose(output_dataset);
+  GDALClose(dataset);
+
+  if (output_options != NULL) CSLDestroy(output_options);
+
+  printf("expanded %d of %d parameters from %d LUT rows\n", nselect, lut.ncol, lut.nrow);
+
+  free((void*)index);
+  free((void*)cost);
+  free((void*)select);
+  free((void*)output);
+  free_table(&lut);
+  if (file.map != NULL) close_lutfile(&file);
+
+  return SUCCESS;
+
+}
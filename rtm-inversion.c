@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <float.h>
+#include <stdint.h>
 
 
 /** Geospatial Data Abstraction Library (GDAL) **/
@@ -14,18 +15,117 @@
 #include "utils/dir.h"
 #include "utils/string.h"
 #include "utils/table.h"
+#include "utils/ivf.h"
+#include "utils/search.h"
+#include "utils/cache.h"
+#include "utils/stats.h"
+#include "utils/refine.h"
+#include "utils/lutfile.h"
 
-//#include <omp.h>
+#include <omp.h>
+
+
+// number of valid cells that are inverted together
+#define BLOCK_CELLS NPOW_12
+
+// aggregation of the k best LUT rows
+enum { _AGG_MEAN_, _AGG_MEDIAN_, _AGG_IDW_, _AGG_LINEAR_ };
+
+// search strategies, the planner picks one per LUT
+enum { _SEARCH_AUTO_, _SEARCH_BLOCKED_, _SEARCH_BRUTE_, _SEARCH_SAMPLE_, _SEARCH_PREFILTER_, _SEARCH_IVF_, _SEARCH_LENGTH_ };
+const char *search_names[_SEARCH_LENGTH_] = { "auto", "blocked", "brute", "sample", "prefilter", "ivf" };
+
+// minimum number of cells per window that is decoded by one thread
+#define READ_CELLS NPOW_16
+
+// side length of the pixel blocks that are compared by hash
+#define HASH_BLOCK 64
+
+// number of sample pixels for planning, and LUT rows x bands per candidate
+#define PLAN_PIXELS NPOW_10
+#define PLAN_WORK   NPOW_16*NPOW_10
+
+// maximum number of LUT rows that are attached to the index output
+#define INDEX_RAT_ROWS NPOW_12
 
 void usage(char *exe, int exit_code){
 
   printf("\n");
   printf("Usage: %s -l LUT.csv -s simulations.csv -i input.tif -o output.tif [-a 0.01] [-n 100]\n", exe);
+  printf("       [-c 0] [-p 1] [-r 1000] [-C 65536] [-w] [-t] [-k 1] [-A mean]\n");
+  printf("       [-f mae] [-z] [-W 1,1,...] [-x red,nir] [-X 0] [-M 0] [-S auto] [-R] [-O float32]\n");
+  printf("       [-u previous_input.tif -U previous_output.tif] [-b 1,2,...]\n");
+  printf("       [-g classes.tif -G classes.csv]\n");
   printf("  \n");
   printf("  adapt file names\n");
-  printf("  -a inversion stops when accuracy is met\n");
+  printf("  -i and -o can be repeated to invert several dates with one LUT, the\n");
+  printf("   n-th input is written to the n-th output, dates are processed in order\n");
+  printf("  -l and -s can be repeated to invert against several LUTs in one pass,\n");
+  printf("   the name of each LUT is then appended to the output names\n");
+  printf("  -l can also be a LUT compiled with rtm-lut-compile, -s is then omitted\n");
+  printf("   its search spectra are used in place if they were compiled with the same\n");
+  printf("   -f, -z and -W, and no -b is given. Otherwise, each process copies them\n");
+  printf("  -S search strategy: auto, blocked, brute, sample, prefilter or ivf\n");
+  printf("   auto times the strategies on a sample of pixels of the first date, and\n");
+  printf("   picks the fastest one whose best cost is within -a of the exact best cost\n");
+  printf("   for 99%% of the sample (default). The others force a strategy\n");
+  printf("   blocked and brute search the whole LUT, blocked many pixels at once\n");
+  printf("  -a accuracy: sample and prefilter stop when the best cost is below -a,\n");
+  printf("   and auto accepts strategies whose best cost is within -a of the exact one\n");
+  printf("   LUT rows are sampled without replacement in stratified order of the parameters\n");
   printf("  -n inversion stops when max iterations are used\n");
-  printf("   use -a 0 to disable accuracy check, this brute-forces the inversion\n");
+  printf("   use -a 0 to disable accuracy check, this brute-forces the inversion,\n");
+  printf("   and auto only picks strategies that find the exact best rows\n");
+  printf("  -c number of clusters for approximate nearest-neighbour search (ivf)\n");
+  printf("   use -c 0 to disable approximate search in auto (default)\n");
+  printf("  -p number of clusters to probe per pixel (speed vs. recall)\n");
+  printf("   -p equal to -c gives exact results\n");
+  printf("  -r number of sample pixels for evaluating recall against brute force\n");
+  printf("   use -r 0 to disable the evaluation\n");
+  printf("  -C number of spectra cached per thread, repeated spectra are not searched again\n");
+  printf("   use -C 0 to disable the cache\n");
+  printf("  -w warm-start the search with the best rows of already inverted neighbours\n");
+  printf("   the brute-force search then abandons LUT rows that cannot beat the neighbours\n");
+  printf("  -t warm-start the search with each pixel's solution from the previous date\n");
+  printf("  -k number of best LUT rows that are aggregated per pixel\n");
+  printf("   with -k > 1, the output holds the aggregated parameters, their spread,\n");
+  printf("   and the cost of the best row. -w and -t need -k 1\n");
+  printf("  -A aggregation of the k best rows: mean (spread: standard deviation)\n");
+  printf("   or median (spread: median absolute deviation)\n");
+  printf("   idw and linear refine the inversion between the LUT nodes:\n");
+  printf("   idw weights the k best rows by their inverse squared cost,\n");
+  printf("   linear fits the spectra of the k best rows as a linear function of their\n");
+  printf("   parameters, and solves it for the pixel (needs -k > number of parameters)\n");
+  printf("   the spread is then the weighted standard deviation around the estimate\n");
+  printf("  -f cost function: mae, rmse or sam (spectral angle in radians)\n");
+  printf("   the cost of the best row is written to the last output band\n");
+  printf("  -z normalize bands to z-scores with mean and standard deviation of the LUT\n");
+  printf("  -W comma-separated band weights, one per band\n");
+  printf("  -x prefilter LUT rows with the difference index of two bands (1-based),\n");
+  printf("   e.g. NIR - red. Rows are scanned from the closest index outwards, until\n");
+  printf("   no better row can be left. This is exact, unless -X is given\n");
+  printf("   without -x, the band pair that spreads the LUT rows most is used\n");
+  printf("  -X maximum index distance of the prefilter (speed vs. accuracy)\n");
+  printf("   use -X 0 for exact search (default)\n");
+  printf("  -M stream the LUT from disk in chunks that fit into this memory budget (MB)\n");
+  printf("   the search is then always exhaustive, and the cache is not used\n");
+  printf("   -M cannot be combined with -z, -k > 1, -c, -x, -w, -t, -b, -g or -S other than blocked\n");
+  printf("   use -M 0 to read the whole LUT into memory (default)\n");
+  printf("  -R write the best LUT row (Int32) and the scaled cost instead of the parameters\n");
+  printf("   the LUT is referenced in the metadata by its absolute path, LUTs of up to\n");
+  printf("   %d rows are also attached as raster attribute table\n", INDEX_RAT_ROWS);
+  printf("   use rtm-expand to derive parameter rasters. -R needs -k 1, and no -O\n");
+  printf("  -u and -U re-invert only the pixels that differ from a previous input,\n");
+  printf("   the others are copied from the previous output. Options that change the\n");
+  printf("   output need to match the previous run. Needs a single input, and no -R\n");
+  printf("  -b comma-separated bands (1-based) that are used for the inversion, default: all\n");
+  printf("   the input holds all bands of the simulations, -W and -x refer to all bands\n");
+  printf("  -g class raster, e.g. land cover, with the dimensions of the input\n");
+  printf("  -G class of each LUT row, one value per line. Pixels are only compared\n");
+  printf("   with the LUT rows of their class, pixels of other classes are nodata\n");
+  printf("   -G is repeated for several LUTs. -g and -G cannot be combined with -M\n");
+  printf("  -O output type: float32, int16 or uint16. Integer bands are scaled to the\n");
+  printf("   range of the LUT parameters, scale and offset are stored with each band\n");
   printf("\n");
 
   exit(exit_code);
@@ -41,42 +141,119 @@ typedef struct {
   short **image;
 } image_t;
 
+typedef struct lut_s {
+  table_t parameters;   // LUT parameters
+  table_t simulations;  // LUT spectra, all bands, the selected bands are active
+  search_t search;      // LUT spectra, prepared for searching
+  ivf_t ivf;            // approximate search index
+  cache_t *caches;      // spectral cache, one per thread
+  int *rows;            // best LUT row of each cell at the latest valid date
+  int chunk;            // number of LUT rows per streamed chunk, or 0
+  int strategy;         // search strategy
+  lutfile_t file;       // compiled LUT, mapped while the LUT is used
+  int nout;             // number of output bands
+  float **inversion;    // inverted parameters and cost of current date
+  int *map;             // LUT row of each row of a class slice, or NULL
+  int nclass;           // number of class slices, or 0
+  int *classes;         // class of each slice, ascending
+  struct lut_s *slices; // LUT rows of each class, searched instead of the LUT
+  int *start;           // first cell of each slice in cells, nclass+1
+  int *cells;           // valid cells of current date, grouped by slice
+} lut_t;
+
 typedef struct {
-  char lut_path[STRLEN];
-  char simulation_path[STRLEN];
-  char input_path[STRLEN];
-  char output_path[STRLEN];
+  int n_lut;
+  int n_simulation;
+  char **lut_path;
+  char **simulation_path;
+  int n_input;
+  int n_output;
+  char **input_path;
+  char **output_path;
   int max_iterations;
   float accuracy;
+  int nlist;
+  int nprobe;
+  int nrecall;
+  int ncache;
+  bool warm;
+  bool temporal;
+  int k;
+  int aggregate;
+  int metric;
+  bool zscore;
+  char weights[STRLEN];
+  int prefilter[2];
+  float tolerance;
+  float budget;
+  int strategy;
+  bool index;
+  GDALDataType datatype;
+  char previous_input[STRLEN];
+  char previous_output[STRLEN];
+  char bands[STRLEN];
+  char class_path[STRLEN];
+  int n_class;
+  char **lut_class_path;
 } args_t;
 
 
 void parse_args(int argc, char *argv[], args_t *args){
 int opt;
+int nbuf = NPOW_04;
 
   opterr = 0;
 
-  copy_string(args->lut_path, STRLEN, "NULL");
-  copy_string(args->simulation_path, STRLEN, "NULL");
-  copy_string(args->input_path, STRLEN, "NULL");
-  copy_string(args->output_path, STRLEN, "NULL");
+  args->n_lut        = 0;
+  args->n_simulation = 0;
+  alloc_2DC((void***)&args->lut_path,        nbuf, STRLEN, sizeof(char));
+  alloc_2DC((void***)&args->simulation_path, nbuf, STRLEN, sizeof(char));
+
+  args->n_input  = 0;
+  args->n_output = 0;
+  alloc_2DC((void***)&args->input_path,  nbuf, STRLEN, sizeof(char));
+  alloc_2DC((void***)&args->output_path, nbuf, STRLEN, sizeof(char));
+
+  args->n_class = 0;
+  alloc_2DC((void***)&args->lut_class_path, nbuf, STRLEN, sizeof(char));
 
   args->accuracy = 0.01;
   args->max_iterations = 100;
-
-  while ((opt = getopt(argc, argv, "l:s:i:o:a:n:")) != -1){
+  args->nlist = 0;
+  args->nprobe = 1;
+  args->nrecall = 1000;
+  args->ncache = NPOW_16;
+  args->warm = false;
+  args->temporal = false;
+  args->k = 1;
+  args->aggregate = _AGG_MEAN_;
+  args->metric = COST_MAE;
+  args->zscore = false;
+  copy_string(args->weights, STRLEN, "NULL");
+  args->prefilter[0] = args->prefilter[1] = -1;
+  args->tolerance = 0;
+  args->budget = 0;
+  args->strategy = _SEARCH_AUTO_;
+  args->index = false;
+  args->datatype = GDT_Float32;
+  copy_string(args->previous_input,  STRLEN, "NULL");
+  copy_string(args->previous_output, STRLEN, "NULL");
+  copy_string(args->bands, STRLEN, "NULL");
+  copy_string(args->class_path, STRLEN, "NULL");
+
+  while ((opt = getopt(argc, argv, "l:s:i:o:a:n:c:p:r:C:wtk:A:f:zW:x:X:M:S:RO:u:U:b:g:G:")) != -1){
     switch(opt){
       case 'l':
-        copy_string(args->lut_path, STRLEN, optarg);
+        copy_string(args->lut_path[args->n_lut++], STRLEN, optarg);
         break;
       case 's':
-        copy_string(args->simulation_path, STRLEN, optarg);
+        copy_string(args->simulation_path[args->n_simulation++], STRLEN, optarg);
         break;
       case 'i':
-        copy_string(args->input_path, STRLEN, optarg);
+        copy_string(args->input_path[args->n_input++], STRLEN, optarg);
         break;
       case 'o':
-        copy_string(args->output_path, STRLEN, optarg);
+        copy_string(args->output_path[args->n_output++], STRLEN, optarg);
         break;
       case 'a':
         args->accuracy = atof(optarg);
@@ -84,6 +261,107 @@ int opt;
       case 'n':
         args->max_iterations = atoi(optarg);
         break;
+      case 'c':
+        args->nlist = atoi(optarg);
+        break;
+      case 'p':
+        args->nprobe = atoi(optarg);
+        break;
+      case 'r':
+        args->nrecall = atoi(optarg);
+        break;
+      case 'C':
+        args->ncache = atoi(optarg);
+        break;
+      case 'w':
+        args->warm = true;
+        break;
+      case 't':
+        args->temporal = true;
+        break;
+      case 'k':
+        args->k = atoi(optarg);
+        break;
+      case 'A':
+        if (strcmp(optarg, "mean") == 0) {
+          args->aggregate = _AGG_MEAN_;
+        } else if (strcmp(optarg, "median") == 0) {
+          args->aggregate = _AGG_MEDIAN_;
+        } else if (strcmp(optarg, "idw") == 0) {
+          args->aggregate = _AGG_IDW_;
+        } else if (strcmp(optarg, "linear") == 0) {
+          args->aggregate = _AGG_LINEAR_;
+        } else {
+          fprintf(stderr, "unknown aggregation %s\n", optarg);
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'f':
+        if ((args->metric = cost_metric(optarg)) < 0) {
+          fprintf(stderr, "unknown cost function %s\n", optarg);
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'z':
+        args->zscore = true;
+        break;
+      case 'W':
+        copy_string(args->weights, STRLEN, optarg);
+        break;
+      case 'x':
+        if (sscanf(optarg, "%d,%d", &args->prefilter[0], &args->prefilter[1]) != 2 ||
+            args->prefilter[0] < 1 || args->prefilter[1] < 1) {
+          fprintf(stderr, "-x needs two bands, e.g. 3,4\n");
+          usage(argv[0], FAILURE);
+        }
+        args->prefilter[0]--;
+        args->prefilter[1]--;
+        break;
+      case 'X':
+        args->tolerance = atof(optarg);
+        break;
+      case 'M':
+        args->budget = atof(optarg);
+        break;
+      case 'R':
+        args->index = true;
+        break;
+      case 'u':
+        copy_string(args->previous_input, STRLEN, optarg);
+        break;
+      case 'U':
+        copy_string(args->previous_output, STRLEN, optarg);
+        break;
+      case 'b':
+        copy_string(args->bands, STRLEN, optarg);
+        break;
+      case 'g':
+        copy_string(args->class_path, STRLEN, optarg);
+        break;
+      case 'G':
+        copy_string(args->lut_class_path[args->n_class++], STRLEN, optarg);
+        break;
+      case 'O':
+        if (strcmp(optarg, "float32") == 0) {
+          args->datatype = GDT_Float32;
+        } else if (strcmp(optarg, "int16") == 0) {
+          args->datatype = GDT_Int16;
+        } else if (strcmp(optarg, "uint16") == 0) {
+          args->datatype = GDT_UInt16;
+        } else {
+          fprintf(stderr, "unknown output type %s\n", optarg);
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'S':
+        for (args->strategy = 0; args->strategy < _SEARCH_LENGTH_; args->strategy++) {
+          if (strcmp(optarg, search_names[args->strategy]) == 0) break;
+        }
+        if (args->strategy == _SEARCH_LENGTH_) {
+          fprintf(stderr, "unknown search strategy %s\n", optarg);
+          usage(argv[0], FAILURE);
+        }
+        break;
       case '?':
         if (isprint(optopt)){
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -95,16 +373,119 @@ int opt;
         fprintf(stderr, "Error parsing arguments.\n");
         usage(argv[0], FAILURE);
     }
+
+    if (args->n_lut == nbuf || args->n_simulation == nbuf ||
+        args->n_input == nbuf || args->n_output == nbuf || args->n_class == nbuf) {
+      re_alloc_2DC((void***)&args->lut_path,        nbuf, STRLEN, nbuf*2, STRLEN, sizeof(char));
+      re_alloc_2DC((void***)&args->simulation_path, nbuf, STRLEN, nbuf*2, STRLEN, sizeof(char));
+      re_alloc_2DC((void***)&args->input_path,      nbuf, STRLEN, nbuf*2, STRLEN, sizeof(char));
+      re_alloc_2DC((void***)&args->output_path,     nbuf, STRLEN, nbuf*2, STRLEN, sizeof(char));
+      re_alloc_2DC((void***)&args->lut_class_path,  nbuf, STRLEN, nbuf*2, STRLEN, sizeof(char));
+      nbuf *= 2;
+    }
+
   }
 
-  if (strcmp(args->lut_path, "NULL") == 0 ||
-      strcmp(args->simulation_path, "NULL") == 0 ||
-      strcmp(args->input_path, "NULL") == 0 ||
-      strcmp(args->output_path, "NULL") == 0) {
+  if (args->n_lut == 0 || args->n_input == 0 || args->n_output == 0) {
     fprintf(stderr, "missing arguments\n");
     usage(argv[0], FAILURE);
   }
 
+  // compiled LUTs hold their simulations
+  if (args->n_simulation > 0 && args->n_lut != args->n_simulation) {
+    fprintf(stderr, "number of LUTs (%d) and simulations (%d) differ\n", args->n_lut, args->n_simulation);
+    usage(argv[0], FAILURE);
+  }
+
+  // outputs are named after the LUTs, so these need to be unique
+  for (int i = 0; i < args->n_lut && args->n_lut > 1; i++) {
+    for (int j = 0; j < i; j++) {
+      char name_i[STRLEN], name_j[STRLEN];
+      basename_without_ext(args->lut_path[i], name_i, STRLEN);
+      basename_without_ext(args->lut_path[j], name_j, STRLEN);
+      if (strcmp(name_i, name_j) == 0) {
+        fprintf(stderr, "LUT names need to be unique when several LUTs are given (%s)\n", name_i);
+        usage(argv[0], FAILURE);
+      }
+    }
+  }
+
+  if (args->n_input != args->n_output) {
+    fprintf(stderr, "number of inputs (%d) and outputs (%d) differ\n", args->n_input, args->n_output);
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->nlist < 0 || args->nprobe < 1 || args->nrecall < 0 || args->ncache < 0) {
+    fprintf(stderr, "-c, -r and -C need to be >= 0, -p needs to be >= 1\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->k < 1) {
+    fprintf(stderr, "-k needs to be >= 1\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->k == 1 && (args->aggregate == _AGG_IDW_ || args->aggregate == _AGG_LINEAR_)) {
+    fprintf(stderr, "-A idw and -A linear need -k > 1\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->k > 1 && (args->warm || args->temporal)) {
+    fprintf(stderr, "-w and -t can only be used with -k 1\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if ((strcmp(args->previous_input, "NULL") == 0) != (strcmp(args->previous_output, "NULL") == 0)) {
+    fprintf(stderr, "-u and -U need to be given together\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (strcmp(args->previous_input, "NULL") != 0 && (args->n_input > 1 || args->index)) {
+    fprintf(stderr, "-u and -U need a single input, and cannot be combined with -R\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->index && args->k > 1) {
+    fprintf(stderr, "-R can only be used with -k 1\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->index && args->datatype != GDT_Float32) {
+    fprintf(stderr, "-R cannot be combined with -O int16 or uint16\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->strategy == _SEARCH_BLOCKED_ && (args->warm || args->temporal)) {
+    fprintf(stderr, "-S blocked cannot be combined with -w or -t\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if ((strcmp(args->class_path, "NULL") == 0) != (args->n_class == 0)) {
+    fprintf(stderr, "-g and -G need to be given together\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->n_class > 0 && args->n_class != args->n_lut) {
+    fprintf(stderr, "number of LUTs (%d) and LUT classes (%d) differ\n", args->n_lut, args->n_class);
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->budget < 0) {
+    fprintf(stderr, "-M needs to be >= 0\n");
+    usage(argv[0], FAILURE);
+  }
+
+  // streamed chunks are only searched exhaustively, in one pass over the image
+  if (args->budget > 0) {
+    if (args->zscore || args->k > 1 || args->nlist > 0 || args->prefilter[0] >= 0 || args->warm || args->temporal ||
+        (args->strategy != _SEARCH_AUTO_ && args->strategy != _SEARCH_BLOCKED_) ||
+        strcmp(args->bands, "NULL") != 0 || args->n_class > 0) {
+      fprintf(stderr, "-M cannot be combined with -z, -k > 1, -c, -x, -w, -t, -b, -g or -S other than blocked\n");
+      usage(argv[0], FAILURE);
+    }
+    args->ncache = 0;
+  }
+
   int n_input = argc-optind;
 
   if (n_input > 0) {
@@ -116,266 +497,1999 @@ int opt;
 }
 
 
-int main ( int argc, char *argv[] ){
+int compact_valid(image_t *input, int *valid){
+char *nodata = NULL;
+int nvalid = 0;
 
 
-args_t args;
+  alloc((void**)&nodata, input->ncell, sizeof(char));
 
-  parse_args(argc, argv, &args);
+  // band-wise pass, this runs over contiguous memory
+  for (int b = 0; b < input->nband; b++) {
+    short *band = input->image[b];
+    for (int c = 0; c < input->ncell; c++) {
+      nodata[c] |= (band[c] == SHRT_MIN) | (band[c] == SHRT_MAX);
+    }
+  }
 
-  table_t lut = read_table(args.lut_path, false, false);
-  table_t simulations = read_table(args.simulation_path, false, false);
+  for (int c = 0; c < input->ncell; c++) {
+    if (!nodata[c]) valid[nvalid++] = c;
+  }
 
-  if (lut.nrow != simulations.nrow) {
-    fprintf(stderr, "LUT and simulations have different number of rows (%d vs %d)\n", lut.nrow, simulations.nrow);
-    usage(argv[0], FAILURE);
+  free((void*)nodata);
+
+  return nvalid;
+}
+
+
+int batch_position(int *cells, int n, int cell){
+int lo = 0, hi = n-1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (cells[mid] == cell) return mid;
+    if (cells[mid] < cell) lo = mid + 1; else hi = mid - 1;
   }
 
-  //for (int i = 0; i < simulations.nrow; i++) {
-  //  for (int j = 0; j < simulations.ncol; j++) {
-  //    simulations.data[i][j];
-  //  }
-  //}
+  return -1;
+}
 
 
-  print_table(&lut, true, false);
-  print_table(&simulations, true, false);
+// class of each cell, from the first band of the class raster
+int *read_classes(char *path, image_t *input, char *exe){
+GDALDatasetH dataset;
+int *classes = NULL;
 
-  //for (int i = 0; i < simulations.nrow; i++) {
-  //  for (int j = 0; j < simulations.ncol; j++) {
-  //    simulations.data[i][j] = (simulations.data[i][j] - simulations.mean[j]) / simulations.sd[j];
-  //  }
-  //}
 
-  GDALAllRegister();
+  if ((dataset = GDALOpen(path, GA_ReadOnly)) == NULL){ 
+    fprintf(stderr, "could not open %s\n", path); 
+    usage(exe, FAILURE);
+  }
 
-  GDALDatasetH dataset;
-  image_t input;
+  int nrow = GDALGetRasterYSize(dataset);
+  int ncol = GDALGetRasterXSize(dataset);
 
-  if ((dataset = GDALOpen(args.input_path, GA_ReadOnly)) == NULL){ 
-    fprintf(stderr, "could not open %s\n", args.input_path); 
-    usage(argv[0], FAILURE);
+  if (nrow != input->nrow || ncol != input->ncol) {
+    fprintf(stderr, "dimensions of %s (%d x %d) differ from input (%d x %d)\n", 
+      path, nrow, ncol, input->nrow, input->ncol);
+    usage(exe, FAILURE);
   }
 
-  input.ncol  = GDALGetRasterXSize(dataset);
-  input.nrow  = GDALGetRasterYSize(dataset);
-  input.ncell = input.ncol*input.nrow;
-  
-  copy_string(input.projection, STRLEN, GDALGetProjectionRef(dataset));
-  GDALGetGeoTransform(dataset, input.geotransformation);
+  alloc((void**)&classes, input->ncell, sizeof(int));
+
+  if (GDALRasterIO(GDALGetRasterBand(dataset, 1), GF_Read, 0, 0, input->ncol, input->nrow, 
+      classes, input->ncol, input->nrow, GDT_Int32, 0, 0) == CE_Failure){
+    printf("could not read band %d from %s\n", 1, path);
+    usage(exe, FAILURE);
+  }
 
+  GDALClose(dataset);
+
+  return classes;
+}
 
-  input.nband = GDALGetRasterCount(dataset);
 
-  if (input.nband != simulations.ncol) {
-    fprintf(stderr, "number of bands (%d) does not match number of simulations (%d)\n", input.nband, simulations.ncol);
-    usage(argv[0], FAILURE);
+// valid cells are grouped by the class slices of a LUT, in ascending order
+// within each slice. Cells of classes without LUT rows are not inverted
+int group_classes(lut_t *lut, const int *classes, const int *valid, int nvalid){
+int *slice = NULL, *fill = NULL;
+
+
+  alloc((void**)&slice, nvalid, sizeof(int));
+  alloc((void**)&fill, lut->nclass, sizeof(int));
+  alloc((void**)&lut->cells, nvalid, sizeof(int));
+
+  memset(lut->start, 0, (lut->nclass+1)*sizeof(int));
+
+  for (int v = 0; v < nvalid; v++) {
+    slice[v] = batch_position(lut->classes, lut->nclass, classes[valid[v]]);
+    if (slice[v] >= 0) lut->start[slice[v]+1]++;
   }
 
-  alloc_2D((void***)&input.image, input.nband, input.ncell, sizeof(short));
+  for (int s = 0; s < lut->nclass; s++) {
+    lut->start[s+1] += lut->start[s];
+    fill[s] = lut->start[s];
+  }
 
-  for (int b = 0; b < input.nband; b++) {
+  for (int v = 0; v < nvalid; v++) {
+    if (slice[v] >= 0) lut->cells[fill[slice[v]]++] = valid[v];
+  }
 
-    GDALRasterBandH band;
+  free((void*)slice);
+  free((void*)fill);
 
-    band = GDALGetRasterBand(dataset, b+1);
-    //int has_nodata = 0;
+  return lut->start[lut->nclass];
+}
 
-    //input.nodata = GDALGetRasterNoDataValue(band, &has_nodata);
-    //if (!has_nodata) {
-    //  fprintf(stderr, "%s has no nodata value.\n", args.input_path); 
-    //  usage(argv[0], FAILURE);
-    //}
 
-    input.datatype = GDALGetRasterDataType(band);
-    if (input.datatype > GDT_Int16) {
-      printf("datatype needs to ne Int16 (is: %s)\n", GDALGetDataTypeName(input.datatype)); 
-      usage(argv[0], FAILURE);
-    }
+void warm_start(search_t *search, const float *pixel, int *cells, int p, int *rows, int ncol, int *best, float *cost){
+int c = cells[p];
+int x = c % ncol;
+int neighbours[4] = { c-1, c-ncol-1, c-ncol, c-ncol+1 };
+bool inside[4] = { x > 0, x > 0, true, x < ncol-1 };
 
-    if (GDALRasterIO(band, GF_Read, 0, 0, input.ncol, input.nrow, input.image[b], 
-        input.ncol, input.nrow, GDT_Int16, 0, 0) == CE_Failure){
-      printf("could not read band %d from %s\n", b+1, args.input_path); 
-      usage(argv[0], FAILURE);
+
+  // neighbours to the left and above are inverted before this pixel
+  for (int n = 0; n < 4; n++) {
+
+    if (!inside[n] || neighbours[n] < 0) continue;
+
+    int q = batch_position(cells, p, neighbours[n]);
+    if (q < 0 || rows[q] < 0 || rows[q] == *best) continue;
+
+    float mae = search_cost(search, pixel, rows[q]);
+
+    if (mae < *cost) {
+      *cost = mae;
+      *best = rows[q];
     }
 
   }
 
-  printf("file: %s\n", args.input_path);
-  printf("projection: %s\n", input.projection);
-  printf("origin: %.6f %.6f\n", input.geotransformation[0], input.geotransformation[3]);
-  printf("resolution: %.6f %.6f\n", input.geotransformation[1], input.geotransformation[5]);
-  printf("dimensions: %d x %d = %d pixels\n", input.nrow, input.ncol, input.ncell);
-  printf("bands: %d\n", input.nband);
-  //printf("nodata: %f\n", input.nodata);
-  printf("datatype: %s\n", GDALGetDataTypeName(input.datatype));
-  printf("\n");
+  return;
+}
 
-  GDALClose(dataset);
 
+// ascending order of integers, for qsort
+int cmp_int(const void *a, const void *b){
+int x = *(const int*)a, y = *(const int*)b;
+
+  return (x > y) - (x < y);
+}
 
 
+// median of a small array, the array is sorted in place
+float median_of(float *x, int n){
 
+  for (int i = 1; i < n; i++) {
+    float v = x[i];
+    int j = i;
+    while (j > 0 && x[j-1] > v) { x[j] = x[j-1]; j--; }
+    x[j] = v;
+  }
 
-  float **inversion = NULL;
-  alloc_2D((void***)&inversion, lut.ncol+1, input.ncell, sizeof(float));
+  return (n % 2) ? x[n/2] : 0.5*(x[n/2-1] + x[n/2]);
+}
 
-  
-  srand(time(NULL)); // initialize random seed
-  
-  //#pragma omp parallel shared(input, inversion, lut, simulations, args) default(none)
-  //{
-  //unsigned int seed = time(NULL) ^ omp_get_thread_num();
-// Use rand_r(&seed) for random numbers in this thread
-//  #pragma omp for
-  for (int c = 0; c < input.ncell; c++) {
 
-    for (int o = 0; o < lut.ncol; o++) {
-      inversion[o][c] = -1.0;
+// aggregate the parameters of the k best LUT rows to mean and standard
+// deviation, or to median and median absolute deviation, or refine them
+// between the LUT nodes, followed by the mae of the best row
+void aggregate(table_t *lut, search_t *search, const short *key, const int *row, const float *cost, int k, int method, float *values, double *work, float **inversion, int c){
+int n = 0;
+
+
+  while (n < k && row[n] >= 0) n++;
+
+  if (n == 0) return;
+
+  if (method == _AGG_IDW_ || method == _AGG_LINEAR_) {
+
+    int npar = lut->ncol, nband = search->nband;
+    float *estimate = values;
+    float *spread   = estimate + npar;
+    float *param    = spread + npar;
+    float *spec     = param + k*npar;
+    float *x        = spec + k*nband;
+
+    for (int j = 0; j < n; j++) {
+      for (int o = 0; o < npar; o++) param[j*npar+o] = table_get(lut, row[j], o);
     }
-    inversion[lut.ncol][c] = -1.0; // store -1.0 for mae in addtional band
 
+    bool fitted = false;
+
+    if (method == _AGG_LINEAR_) {
+      for (int j = 0; j < n; j++) memcpy(spec + j*nband, search->spec + (size_t)row[j]*nband, nband*sizeof(float));
+      search_transform(search, key, x);
+      fitted = refine_linear(x, spec, param, cost, n, nband, npar, work, estimate, spread);
+    }
 
-    int skip = 0;
+    // too few neighbours for a linear fit
+    if (!fitted) refine_idw(param, cost, n, npar, estimate, spread);
 
-    for (int b = 0; b < input.nband; b++) {
-      if (input.image[b][c] == SHRT_MIN ||
-          input.image[b][c] == SHRT_MAX) {
-        skip = 1;
-        break;
-      }
+    for (int o = 0; o < npar; o++) {
+      inversion[o][c] = estimate[o];
+      inversion[npar+o][c] = spread[o];
     }
 
-    if (skip) continue;
-    
+    inversion[2*npar][c] = cost[0];
+
+    return;
 
-    float min_mae = FLT_MAX;
-    int i_min_mae = -1;
-    int ctr = 0;
+  }
 
-    // brute-force inversion
-    if (args.accuracy <= FLT_EPSILON) {
+  for (int o = 0; o < lut->ncol; o++) {
 
-      for (int i = 0; i < simulations.nrow; i++) {
+    if (method == _AGG_MEAN_) {
 
-        float mae = 0.0;
+      double mx = 0, vx = 0;
 
-        for (int b = 0; b < input.nband; b++) {
-          //float ref = (input.image[b][c] - simulations.mean[b]) / simulations.sd[b];
-          float ref = (float)input.image[b][c];
-          mae += fabs(ref - simulations.data[i][b]);
-        }
+      for (int j = 0; j < n; j++) var_recurrence(table_get(lut, row[j], o), &mx, &vx, j+1);
 
-        mae /= input.nband;
+      inversion[o][c] = mx;
+      inversion[lut->ncol+o][c] = (n > 1) ? standdev(vx, n) : 0;
 
-        if (mae < min_mae) {
-          min_mae = mae;
-          i_min_mae = i;
-        }
+    } else {
+
+      float *deviation = values + k;
+
+      for (int j = 0; j < n; j++) values[j] = table_get(lut, row[j], o);
+      float median = median_of(values, n);
+
+      for (int j = 0; j < n; j++) deviation[j] = fabsf(table_get(lut, row[j], o) - median);
+
+      inversion[o][c] = median;
+      inversion[lut->ncol+o][c] = median_of(deviation, n);
+
+    }
+
+  }
+
+  inversion[2*lut->ncol][c] = cost[0]; // store min mae in addtional band
+
+  return;
+}
 
+
+// FNV-1a hash of the band vectors in a block of pixels
+uint64_t hash_block(image_t *image, int x0, int y0, int nx, int ny){
+uint64_t hash = 14695981039346656037ULL;
+
+
+  for (int b = 0; b < image->nband; b++) {
+    for (int y = y0; y < y0+ny; y++) {
+      const unsigned char *bytes = (const unsigned char*)(image->image[b] + (size_t)y*image->ncol + x0);
+      for (size_t i = 0; i < nx*sizeof(short); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
       }
+    }
+  }
 
-    // use accuracy to early-stop inversion
-    } else {
+  return hash;
+}
 
-      while (min_mae > args.accuracy && ctr < args.max_iterations) {
 
-        // randomly select a row from the LUT
-        int i = rand() % simulations.nrow;
-        
-        float mae = 0.0;
+// drop the valid pixels that equal the previous input. Blocks with the same
+// hash are unchanged, pixels in the other blocks are compared one by one
+int changed_valid(image_t *input, image_t *previous, int *valid, int nvalid, bool *unchanged){
+int nchanged = 0, nblock = 0, nsame = 0;
 
-        for (int b = 0; b < input.nband; b++) {
 
-          //float ref = (input.image[b][c] - simulations.mean[b]) / simulations.sd[b];
-          float ref = (float)input.image[b][c];
-          mae += fabs(ref - simulations.data[i][b]);
-          
-        }
+  #pragma omp parallel for schedule(dynamic) reduction(+: nblock, nsame)
+  for (int y0 = 0; y0 < input->nrow; y0 += HASH_BLOCK) {
 
-        mae /= input.nband;
+    int ny = (input->nrow - y0 < HASH_BLOCK) ? input->nrow - y0 : HASH_BLOCK;
 
-        if (mae < min_mae) {
-          min_mae = mae;
-          i_min_mae = i;
-        }
+    for (int x0 = 0; x0 < input->ncol; x0 += HASH_BLOCK) {
+
+      int nx = (input->ncol - x0 < HASH_BLOCK) ? input->ncol - x0 : HASH_BLOCK;
+      bool same = hash_block(input, x0, y0, nx, ny) == hash_block(previous, x0, y0, nx, ny);
+
+      for (int y = y0; y < y0+ny; y++) {
+        for (int x = x0; x < x0+nx; x++) {
+
+          int c = y*input->ncol + x, b = 0;
 
-        ctr++;
+          if (!same) {
+            while (b < input->nband && input->image[b][c] == previous->image[b][c]) b++;
+          }
 
+          unchanged[c] = same || b == input->nband;
+
+        }
       }
 
+      nblock++;
+      nsame += same;
+
     }
 
-    //printf("cell %d: min mae = %.2f at row %d. %d iterations used\n", c, min_mae, i_min_mae, ctr);
+  }
+
+  for (int v = 0; v < nvalid; v++) {
+    if (!unchanged[valid[v]]) valid[nchanged++] = valid[v];
+  }
+
+  printf("unchanged blocks: %d of %d\n", nsame, nblock);
+  printf("changed pixels: %d of %d valid (%.1f%%)\n", nchanged, nvalid, (nvalid > 0) ? 100.0*nchanged/nvalid : 0);
+  printf("\n");
+
+  return nchanged;
+}
+
+
+// copy the results of unchanged pixels from the previous output
+void copy_previous(char *path, image_t *input, bool *unchanged, lut_t *lut, char *exe){
+GDALDatasetH dataset;
+float *buffer = NULL;
+
+
+  if ((dataset = GDALOpen(path, GA_ReadOnly)) == NULL){ 
+    fprintf(stderr, "could not open %s\n", path); 
+    usage(exe, FAILURE);
+  }
+
+  if (GDALGetRasterXSize(dataset) != input->ncol || GDALGetRasterYSize(dataset) != input->nrow ||
+      GDALGetRasterCount(dataset) != lut->nout) {
+    fprintf(stderr, "%s does not match the input (%d x %d) and output bands (%d)\n", 
+      path, input->nrow, input->ncol, lut->nout);
+    usage(exe, FAILURE);
+  }
+
+  alloc((void**)&buffer, input->ncell, sizeof(float));
+
+  for (int o = 0; o < lut->nout; o++) {
+
+    GDALRasterBandH band = GDALGetRasterBand(dataset, o+1);
+    int has_nodata = 0;
+    double nodata = GDALGetRasterNoDataValue(band, &has_nodata);
+    double scale  = GDALGetRasterScale(band, NULL);
+    double offset = GDALGetRasterOffset(band, NULL);
 
-    if (i_min_mae >= 0) {
-      for (int o = 0; o < lut.ncol; o++) {
-        inversion[o][c] = lut.data[i_min_mae][o];
+    if (GDALRasterIO(band, GF_Read, 0, 0, input->ncol, input->nrow, buffer, 
+        input->ncol, input->nrow, GDT_Float32, 0, 0) == CE_Failure){
+      printf("could not read band %d from %s\n", o+1, path); 
+      usage(exe, FAILURE);
+    }
+
+    // integer outputs are dequantized, nodata is stored as -1.0 again
+    for (int c = 0; c < input->ncell; c++) {
+      if (!unchanged[c]) continue;
+      if (has_nodata && buffer[c] == (float)nodata) {
+        lut->inversion[o][c] = -1.0;
+      } else {
+        lut->inversion[o][c] = buffer[c]*scale + offset;
       }
-      inversion[lut.ncol][c] = min_mae; // store min mae in addtional band
     }
 
   }
 
-  //}
+  free((void*)buffer);
 
-  GDALDatasetH output_dataset = NULL;
-  GDALRasterBandH output_band = NULL;
-  GDALDriverH output_driver = NULL;
-  char **output_options = NULL;
+  GDALClose(dataset);
+
+  return;
+}
+
+
+void evaluate_recall(image_t *input, int *valid, int nvalid, search_t *search, ivf_t *ivf, int nprobe, int nsample){
+unsigned int seed = 42;
+int hits = 0;
+double mae_exact = 0, mae_approx = 0;
+double t_exact = 0, t_approx = 0, t0;
+float pixel[input->nband];
+
+
+  if (nvalid == 0) return;
+
+  if (nsample > nvalid) nsample = nvalid;
+
+  for (int s = 0; s < nsample; s++) {
+
+    int c = valid[rand_r(&seed) % nvalid];
+    float cost_exact = FLT_MAX, cost_approx = FLT_MAX;
+
+    short key[input->nband];
+    for (int b = 0; b < input->nband; b++) key[b] = input->image[b][c];
+    search_transform(search, key, pixel);
+
+    t0 = omp_get_wtime();
+    int i_exact = search_brute(search, pixel, -1, &cost_exact);
+    t_exact += omp_get_wtime() - t0;
+
+    t0 = omp_get_wtime();
+    int i_approx = search_ivf(ivf, pixel, nprobe, -1, &cost_approx);
+    t_approx += omp_get_wtime() - t0;
+
+    // ties count as hit
+    if (i_approx == i_exact || cost_approx <= cost_exact) hits++;
+    mae_exact  += cost_exact;
+    mae_approx += cost_approx;
 
-  if ((output_driver = GDALGetDriverByName("GTiff")) == NULL) {
-    printf("%s driver not found\n", "GTiff"); 
-    usage(argv[0], FAILURE);
   }
 
-  output_options = CSLSetNameValue(output_options, "COMPRESS", "ZSTD");
-  output_options = CSLSetNameValue(output_options, "PREDICTOR", "2");
-  output_options = CSLSetNameValue(output_options, "BIGTIFF", "YES");
-  //output_options = CSLSetNameValue(output_options, "OVERVIEWS", "NONE");
+  printf("recall@1 on %d sample pixels: %.4f\n", nsample, (double)hits/nsample);
+  printf("mean %s: %.4f (brute force) vs %.4f (approximate)\n", cost_name(search->metric), mae_exact/nsample, mae_approx/nsample);
+  printf("speedup vs brute force: %.1fx\n", (t_approx > 0) ? t_exact/t_approx : 0);
+  printf("\n");
 
+  return;
+}
 
-  if ((output_dataset = GDALCreate(output_driver, args.output_path, input.ncol, input.nrow, lut.ncol+1, GDT_Float32, output_options)) == NULL) {
-    printf("Error creating file %s.\n", args.output_path);
-    usage(argv[0], FAILURE);
+
+// read the bands of one window directly into the image buffers
+bool read_window(GDALDatasetH dataset, image_t *input, const int *bands, int x0, int y0, int nx, int ny){
+size_t offset = (size_t)y0*input->ncol + x0;
+
+
+  for (int b = 0; b < input->nband; b++) {
+    if (GDALRasterIO(GDALGetRasterBand(dataset, bands[b]), GF_Read, x0, y0, nx, ny, input->image[b] + offset, 
+        nx, ny, GDT_Int16, sizeof(short), input->ncol*sizeof(short)) == CE_Failure) return false;
   }
 
-  for (int o = 0; o < lut.ncol+1; o++) {
+  return true;
+}
+
 
-    output_band = GDALGetRasterBand(output_dataset, o+1);
-    GDALSetRasterNoDataValue(output_band, -1.0);
+// only the selected bands are read, in the order of the simulations
+void read_input(char *path, image_t *input, int nband, const bool *select, char *exe){
+GDALDatasetH dataset;
+int xblock, yblock, nx, ny, nwindow, failed = 0;
+int bands[nband];
 
-    if (GDALRasterIO(output_band, GF_Write, 0, 0, input.ncol, input.nrow, 
-      inversion[o], input.ncol, input.nrow, GDT_Float32, 0, 0) == CE_Failure){
-      printf("Unable to write band %d in %s.\n", o+1, args.output_path); 
-      usage(argv[0], FAILURE);
-    }
 
+  if ((dataset = GDALOpen(path, GA_ReadOnly)) == NULL){ 
+    fprintf(stderr, "could not open %s\n", path); 
+    usage(exe, FAILURE);
   }
 
-  // one additional band for the mae
-  output_band = GDALGetRasterBand(output_dataset, lut.ncol+1);
-  GDALSetRasterNoDataValue(output_band, -1.0);
+  input->ncol  = GDALGetRasterXSize(dataset);
+  input->nrow  = GDALGetRasterYSize(dataset);
+  input->ncell = input->ncol*input->nrow;
+  
+  copy_string(input->projection, STRLEN, GDALGetProjectionRef(dataset));
+  GDALGetGeoTransform(dataset, input->geotransformation);
 
-  if (GDALRasterIO(output_band, GF_Write, 0, 0, input.ncol, input.nrow, 
-    inversion[lut.ncol], input.ncol, input.nrow, GDT_Float32, 0, 0) == CE_Failure){
-    printf("Unable to write band %d in %s.\n", lut.ncol+1, args.output_path); 
-    usage(argv[0], FAILURE);
+
+  if (GDALGetRasterCount(dataset) != nband) {
+    fprintf(stderr, "number of bands (%d) does not match number of simulations (%d)\n", GDALGetRasterCount(dataset), nband);
+    usage(exe, FAILURE);
   }
 
+  input->nband = 0;
+  for (int b = 0; b < nband; b++) {
+    if (select == NULL || select[b]) bands[input->nband++] = b+1;
+  }
 
-  GDALSetGeoTransform(output_dataset, input.geotransformation);
-  GDALSetProjection(output_dataset,   input.projection);
+  for (int b = 0; b < input->nband; b++) {
 
-  GDALClose(output_dataset);
+    GDALRasterBandH band;
 
-  free_2D((void**)input.image, input.nband);
-  free_2D((void**)inversion, lut.ncol+1);
+    band = GDALGetRasterBand(dataset, bands[b]);
+    //int has_nodata = 0;
 
-  free_table(&lut);
-  free_table(&simulations);
-  
-  if (output_options != NULL) CSLDestroy(output_options);   
+    //input->nodata = GDALGetRasterNoDataValue(band, &has_nodata);
+    //if (!has_nodata) {
+    //  fprintf(stderr, "%s has no nodata value.\n", path); 
+    //  usage(exe, FAILURE);
+    //}
+
+    input->datatype = GDALGetRasterDataType(band);
+    if (input->datatype > GDT_Int16) {
+      printf("datatype needs to ne Int16 (is: %s)\n", GDALGetDataTypeName(input->datatype)); 
+      usage(exe, FAILURE);
+    }
+
+  }
+
+  alloc_2D((void***)&input->image, input->nband, input->ncell, sizeof(short));
+
+
+  // windows are aligned to the native blocks, so that each compressed block
+  // is decoded once. Small blocks, e.g. strips, are stacked vertically
+  GDALGetBlockSize(GDALGetRasterBand(dataset, bands[0]), &xblock, &yblock);
+  if (xblock < 1 || xblock > input->ncol) xblock = input->ncol;
+  if (yblock < 1 || yblock > input->nrow) yblock = input->nrow;
+
+  while ((size_t)xblock*yblock < READ_CELLS && yblock < input->nrow) yblock *= 2;
+  if (yblock > input->nrow) yblock = input->nrow;
+
+  nx = (input->ncol + xblock - 1) / xblock;
+  ny = (input->nrow + yblock - 1) / yblock;
+  nwindow = nx*ny;
+
+  GDALClose(dataset);
+
+
+  // each thread decodes its windows with its own dataset handle
+  #pragma omp parallel num_threads((nwindow < omp_get_max_threads()) ? nwindow : omp_get_max_threads()) reduction(+: failed)
+  {
+
+    GDALDatasetH thread_dataset = GDALOpen(path, GA_ReadOnly);
+
+    #pragma omp for schedule(dynamic)
+    for (int w = 0; w < nwindow; w++) {
+
+      int x0 = (w % nx) * xblock;
+      int y0 = (w / nx) * yblock;
+      int wx = (input->ncol - x0 < xblock) ? input->ncol - x0 : xblock;
+      int wy = (input->nrow - y0 < yblock) ? input->nrow - y0 : yblock;
+
+      if (thread_dataset == NULL || !read_window(thread_dataset, input, bands, x0, y0, wx, wy)) failed++;
+
+    }
+
+    if (thread_dataset != NULL) GDALClose(thread_dataset);
+
+  }
+
+  if (failed > 0) {
+    printf("could not read %d of %d windows from %s\n", failed, nwindow, path); 
+    usage(exe, FAILURE);
+  }
+
+  printf("file: %s\n", path);
+  printf("projection: %s\n", input->projection);
+  printf("origin: %.6f %.6f\n", input->geotransformation[0], input->geotransformation[3]);
+  printf("resolution: %.6f %.6f\n", input->geotransformation[1], input->geotransformation[5]);
+  printf("dimensions: %d x %d = %d pixels\n", input->nrow, input->ncol, input->ncell);
+  printf("bands: %d of %d\n", input->nband, nband);
+  //printf("nodata: %f\n", input->nodata);
+  printf("datatype: %s\n", GDALGetDataTypeName(input->datatype));
+  printf("windows: %d of %d x %d pixels\n", nwindow, yblock, xblock);
+  printf("\n");
+
+  return;
+}
+
+
+// search one pixel with a per-pixel strategy. With k = 1, row and cost
+// may hold a seed, with k > 1 unused rows are padded with -1
+void search_pixel(args_t *args, lut_t *lut, int strategy, const float *pixel, unsigned int *seed, int *row, float *cost){
+search_t *search = &lut->search;
+int k = args->k, n = 0;
+
+
+  if (k == 1) {
+
+    switch (strategy) {
+      case _SEARCH_IVF_:
+        *row = search_ivf(&lut->ivf, pixel, args->nprobe, *row, cost);
+        break;
+      case _SEARCH_PREFILTER_:
+        *row = search_prefilter(search, pixel, args->tolerance, args->accuracy, *row, cost);
+        break;
+      case _SEARCH_SAMPLE_:
+        *row = search_sample(search, pixel, rand_r(seed) % search->nrow, args->max_iterations, args->accuracy, *row, cost);
+        break;
+      default:
+        *row = search_brute(search, pixel, *row, cost);
+    }
+
+    return;
+
+  }
+
+  switch (strategy) {
+    case _SEARCH_IVF_:
+      n = search_ivf_k(&lut->ivf, pixel, args->nprobe, k, row, cost);
+      break;
+    case _SEARCH_PREFILTER_:
+      n = search_prefilter_k(search, pixel, args->tolerance, args->accuracy, k, row, cost);
+      break;
+    case _SEARCH_SAMPLE_:
+      n = search_sample_k(search, pixel, rand_r(seed) % search->nrow, args->max_iterations, args->accuracy, k, row, cost);
+      break;
+    default:
+      n = search_brute_k(search, pixel, k, row, cost);
+  }
+
+  for (int j = n; j < k; j++) { row[j] = -1; cost[j] = FLT_MAX; }
+
+  return;
+}
+
+
+// time the candidate strategies on a sample of valid pixels, and keep the
+// fastest one whose best cost is within -a of the exact best cost on 99%
+// of the sample. The exact reference comes from the blocked search. With
+// -a 0, only strategies that are exact by construction are candidates.
+// Candidates are timed on all threads, as in invert, because the memory-
+// bound blocked search scales differently than the per-pixel searches.
+void plan_search(args_t *args, lut_t *lut, image_t *input, int *valid, int nvalid){
+search_t *search = &lut->search;
+int nband = search->nband, k = args->k;
+int nthread = omp_get_max_threads();
+bool candidate[_SEARCH_LENGTH_];
+double rate[_SEARCH_LENGTH_], met[_SEARCH_LENGTH_];
+float *pixels = NULL, *ref = NULL, *cost = NULL;
+int *row = NULL;
+int best = _SEARCH_BLOCKED_;
+
+
+  for (int s = 0; s < _SEARCH_LENGTH_; s++) { candidate[s] = false; rate[s] = met[s] = 0; }
+
+  candidate[_SEARCH_BLOCKED_]   = !args->warm && !args->temporal;
+  candidate[_SEARCH_BRUTE_]     = args->warm || args->temporal;
+  candidate[_SEARCH_SAMPLE_]    = search->order != NULL;
+  candidate[_SEARCH_PREFILTER_] = search->index != NULL;
+  candidate[_SEARCH_IVF_]       = lut->ivf.nlist > 0;
+
+  // -a 0 asks for the exact best rows, approximate strategies are excluded
+  if (args->accuracy <= 0) {
+    candidate[_SEARCH_SAMPLE_]    &= args->max_iterations >= search->nrow;
+    candidate[_SEARCH_PREFILTER_] &= args->tolerance <= 0;
+    candidate[_SEARCH_IVF_]       &= args->nprobe >= lut->ivf.nlist;
+  }
+
+  if (!candidate[_SEARCH_BLOCKED_]) best = _SEARCH_BRUTE_;
+
+  // sample size is limited by the work per candidate and thread
+  int nsample = PLAN_WORK / ((double)search->nrow*nband);
+  if (nsample > PLAN_PIXELS) nsample = PLAN_PIXELS;
+  if (nsample < SEARCH_TILE) nsample = SEARCH_TILE;
+  nsample *= nthread;
+  if (nsample > nvalid) nsample = nvalid;
+
+  // each thread gets at least one batch
+  int batch = (nsample + nthread - 1) / nthread;
+  if (batch > BLOCK_CELLS) batch = BLOCK_CELLS;
+
+  if (nsample == 0) {
+    lut->strategy = best;
+    printf("search strategy: %s (no valid pixels for planning)\n", search_names[best]);
+    printf("\n");
+    return;
+  }
+
+  alloc((void**)&pixels, (size_t)nsample*nband, sizeof(float));
+  alloc((void**)&ref,  (size_t)nsample*k, sizeof(float));
+  alloc((void**)&cost, (size_t)nsample*k, sizeof(float));
+  alloc((void**)&row,  (size_t)nsample*k, sizeof(int));
+
+  // regular sample over the valid pixels
+  for (int p = 0; p < nsample; p++) {
+    short key[nband];
+    int c = valid[(long)p*nvalid/nsample];
+    for (int b = 0; b < nband; b++) key[b] = input->image[b][c];
+    search_transform(search, key, pixels + p*nband);
+  }
+
+  for (int s = _SEARCH_BLOCKED_; s < _SEARCH_LENGTH_; s++) {
+
+    if (!candidate[s] && s != _SEARCH_BLOCKED_) continue;
+
+    float *result = (s == _SEARCH_BLOCKED_) ? ref : cost;
+
+    double t0 = omp_get_wtime();
+
+    #pragma omp parallel shared(args, lut, search, pixels, row, result, nsample, batch, nband, k, s)
+    {
+
+    unsigned int seed = 42 ^ omp_get_thread_num();
+
+    #pragma omp for schedule(dynamic)
+    for (int p0 = 0; p0 < nsample; p0 += batch) {
+
+      int npix = (nsample - p0 < batch) ? nsample - p0 : batch;
+
+      if (s == _SEARCH_BLOCKED_ && k == 1) {
+        search_blocked(search, pixels + p0*nband, npix, row + p0, result + p0);
+      } else if (s == _SEARCH_BLOCKED_) {
+        search_blocked_k(search, pixels + p0*nband, npix, k, row + p0*k, result + p0*k);
+      } else {
+        for (int p = p0; p < p0+npix; p++) {
+          row[p*k] = -1; result[p*k] = FLT_MAX;
+          search_pixel(args, lut, s, pixels + p*nband, &seed, row + p*k, result + p*k);
+        }
+      }
+
+    }
+
+    }
+
+    rate[s] = nsample / fmax(omp_get_wtime() - t0, 1e-9);
+
+    if (s == _SEARCH_BLOCKED_) { met[s] = 1; continue; }
+
+    for (int p = 0; p < nsample; p++) {
+      if (cost[p*k] <= ref[p*k] + fmax(args->accuracy, 1e-6*ref[p*k])) met[s]++;
+    }
+    met[s] /= nsample;
+
+  }
+
+  for (int s = _SEARCH_BLOCKED_; s < _SEARCH_LENGTH_; s++) {
+    if (candidate[s] && met[s] >= 0.99 && rate[s] > rate[best]) best = s;
+  }
+
+  printf("search planner: %d sample pixels, %d threads\n", nsample, nthread);
+  for (int s = _SEARCH_BLOCKED_; s < _SEARCH_LENGTH_; s++) {
+    if (candidate[s] || s == _SEARCH_BLOCKED_) {
+      printf("  %-10s %12.0f pixels/s, %5.1f%% within accuracy%s\n", 
+        search_names[s], rate[s], 100*met[s], candidate[s] ? "" : " (reference only)");
+    }
+  }
+  printf("search strategy: %s\n", search_names[best]);
+  printf("\n");
+
+  lut->strategy = best;
+
+  // structures of strategies that were not picked are released
+  if (best != _SEARCH_PREFILTER_) free_prefilter(search);
+  if (best != _SEARCH_IVF_ && lut->ivf.nlist > 0) {
+    free_ivf(&lut->ivf);
+    memset(&lut->ivf, 0, sizeof(ivf_t));
+  }
+
+  free((void*)pixels);
+  free((void*)ref);
+  free((void*)cost);
+  free((void*)row);
+
+  return;
+}
+
+
+// pick the search strategy of a LUT, or of a class slice of a LUT
+void plan_lut(args_t *args, lut_t *lut, image_t *input, int *valid, int nvalid){
+
+
+  if (lut->strategy == _SEARCH_AUTO_) {
+    plan_search(args, lut, input, valid, nvalid);
+  } else {
+    printf("search strategy: %s (forced)\n", search_names[lut->strategy]);
+    printf("\n");
+  }
+
+  if (lut->strategy == _SEARCH_IVF_ && args->nrecall > 0) {
+    evaluate_recall(input, valid, nvalid, &lut->search, &lut->ivf, args->nprobe, args->nrecall);
+  }
+
+  return;
+}
+
+
+// the LUTs are searched for the valid cells, these may also be the class
+// slices of a LUT, together with the cells of their class. Cells that are
+// not inverted keep their previous values
+void invert(args_t *args, image_t *input, int *valid, int nvalid, lut_t *luts, int nlut){
+
+
+  // scratch space of aggregate is sized for the LUT with most parameters
+  int npar = 1;
+  for (int l = 0; l < nlut; l++) {
+    if (luts[l].parameters.ncol > npar) npar = luts[l].parameters.ncol;
+  }
+
+  #pragma omp parallel shared(input, valid, nvalid, luts, nlut, args, npar)
+  {
+
+  unsigned int seed = time(NULL) ^ omp_get_thread_num();
+  int k = args->k;
+
+  short *keys = NULL;
+  float *pixels = NULL;
+  float *min_mae = NULL;
+  int *i_min_mae = NULL;
+  int *miss = NULL, *miss_slot = NULL, *miss_row = NULL;
+  float *miss_cost = NULL;
+  float *values = NULL;
+  double *work = NULL;
+  alloc((void**)&keys,      (size_t)BLOCK_CELLS*input->nband, sizeof(short));
+  alloc((void**)&pixels,    (size_t)BLOCK_CELLS*input->nband, sizeof(float));
+  alloc((void**)&min_mae,   (size_t)BLOCK_CELLS*k, sizeof(float));
+  alloc((void**)&i_min_mae, (size_t)BLOCK_CELLS*k, sizeof(int));
+  alloc((void**)&miss,      BLOCK_CELLS, sizeof(int));
+  alloc((void**)&miss_slot, BLOCK_CELLS, sizeof(int));
+  alloc((void**)&miss_row,  (size_t)BLOCK_CELLS*k, sizeof(int));
+  alloc((void**)&miss_cost, (size_t)BLOCK_CELLS*k, sizeof(float));
+  alloc((void**)&values,    (size_t)(k+2)*npar + (size_t)(k+1)*input->nband, sizeof(float));
+  alloc((void**)&work,      refine_work(input->nband, npar), sizeof(double));
+
+  // all batches hold the same number of valid pixels
+  #pragma omp for schedule(dynamic)
+  for (int v0 = 0; v0 < nvalid; v0 += BLOCK_CELLS) {
+
+    int npix = (nvalid - v0 < BLOCK_CELLS) ? nvalid - v0 : BLOCK_CELLS;
+
+    // gather valid pixels into a dense pixel-major batch
+    for (int b = 0; b < input->nband; b++) {
+      short *band = input->image[b];
+      for (int p = 0; p < npix; p++) keys[p*input->nband+b] = band[valid[v0+p]];
+    }
+
+
+    // the batch stays in cache while it is searched against each LUT
+    for (int l = 0; l < nlut; l++) {
+
+      table_t  *lut       = &luts[l].parameters;
+      search_t *search    = &luts[l].search;
+      int      *rows      = luts[l].rows;
+      int      *map       = luts[l].map;
+      float   **inversion = luts[l].inversion;
+
+      // each thread keeps its own cache per LUT for the whole run
+      cache_t  *cache     = luts[l].caches + omp_get_thread_num();
+
+
+      // repeated spectra are taken from the cache, the others are compacted
+      // to the front of the batch for searching. Within the batch, the first
+      // occurrence of a spectrum is tagged as pending in the cache, and its
+      // duplicates are resolved from that occurrence after the search.
+      int nmiss = 0;
+
+      for (int p = 0; p < npix; p++) {
+
+        short *key = keys + p*input->nband;
+        int slot = -1;
+
+        if (args->ncache > 0) {
+
+          if (cache_lookup(cache, key, &slot)) {
+            if (cache->row[(size_t)slot*k] < CACHE_EMPTY) {
+              miss[p] = -2 - cache->row[(size_t)slot*k]; // pending, resolve from miss
+            } else {
+              miss[p] = -1; // resolved
+              memcpy(i_min_mae + p*k, cache->row  + (size_t)slot*k, k*sizeof(int));
+              memcpy(min_mae   + p*k, cache->cost + (size_t)slot*k, k*sizeof(float));
+            }
+            continue;
+          }
+
+          cache_insert(cache, slot, key, -2 - nmiss, 0);
+
+        }
+
+        // normalization and weights, as folded into the LUT
+        search_transform(search, key, pixels + nmiss*input->nband);
+
+        miss_slot[nmiss] = slot;
+        miss[p] = nmiss++;
+
+      }
+
+
+      // brute-force inversion, the whole batch is searched at once
+      if (luts[l].strategy == _SEARCH_BLOCKED_) {
+
+        if (k == 1) {
+          search_blocked(search, pixels, nmiss, miss_row, miss_cost);
+        } else {
+          search_blocked_k(search, pixels, nmiss, k, miss_row, miss_cost);
+        }
+
+      // the k best rows of each pixel are kept in a bounded heap
+      } else if (k > 1) {
+
+        for (int m = 0; m < nmiss; m++) {
+
+          search_pixel(args, &luts[l], luts[l].strategy, pixels + m*input->nband, &seed, miss_row + m*k, miss_cost + m*k);
+
+        }
+
+      } else {
+
+        // results become available to the neighbours as the search proceeds
+        for (int p = 0; p < npix; p++) {
+          if (miss[p] >= 0) i_min_mae[p] = -1;
+        }
+
+        for (int m = 0, p = 0; m < nmiss; m++, p++) {
+
+          // pixel of this miss, misses are in pixel order
+          while (miss[p] != m) p++;
+
+          float *pixel = pixels + m*input->nband;
+          int   *i_min = miss_row  + m;
+          float *min   = miss_cost + m;
+
+          *i_min = -1;
+          *min = FLT_MAX;
+
+          // seed the search with the solution of the previous date, rows
+          // are kept as LUT rows, and are searched for within a slice
+          int previous = args->temporal ? rows[valid[v0+p]] : -1;
+          if (previous >= 0 && map != NULL) previous = batch_position(map, search->nrow, previous);
+
+          if (args->temporal && previous >= 0) {
+            *i_min = previous;
+            *min = search_cost(search, pixel, *i_min);
+          }
+
+          // seed the search with the best rows of inverted neighbours
+          if (args->warm) warm_start(search, pixel, valid + v0, p, i_min_mae, input->ncol, i_min, min);
+
+          search_pixel(args, &luts[l], luts[l].strategy, pixel, &seed, i_min, min);
+
+          i_min_mae[p] = *i_min;
+
+        }
+
+      }
+
+
+      // expand search results to the pixels, and update the cache
+      for (int m = 0; m < nmiss; m++) {
+        int slot = miss_slot[m];
+        if (args->ncache > 0 && cache->row[(size_t)slot*k] == -2 - m) {
+          cache_store(cache, slot, miss_row + m*k, miss_cost + m*k);
+        }
+      }
+
+      for (int p = 0; p < npix; p++) {
+        if (miss[p] >= 0) {
+          memcpy(i_min_mae + p*k, miss_row  + miss[p]*k, k*sizeof(int));
+          memcpy(min_mae   + p*k, miss_cost + miss[p]*k, k*sizeof(float));
+        }
+      }
+
+
+      // scatter results back to their cells
+      for (int p = 0; p < npix; p++) {
+
+        int c = valid[v0+p];
+
+        //printf("cell %d: min mae = %.2f at row %d\n", c, min_mae[p], i_min_mae[p]);
+
+        if (k > 1) {
+          aggregate(lut, search, keys + p*input->nband, i_min_mae + p*k, min_mae + p*k, k, args->aggregate, values, work, inversion, c);
+        } else if (i_min_mae[p] >= 0) {
+          rows[c] = (map != NULL) ? map[i_min_mae[p]] : i_min_mae[p];
+          for (int o = 0; o < lut->ncol; o++) {
+            inversion[o][c] = table_get(lut, i_min_mae[p], o);
+          }
+          inversion[lut->ncol][c] = min_mae[p]; // store min mae in addtional band
+        }
+
+      }
+
+    }
+
+  }
+
+  free((void*)keys);
+  free((void*)pixels);
+  free((void*)min_mae);
+  free((void*)i_min_mae);
+  free((void*)miss);
+  free((void*)miss_slot);
+  free((void*)miss_row);
+  free((void*)miss_cost);
+  free((void*)values);
+  free((void*)work);
+
+  }
+
+  return;
+}
+
+
+void invert_stream(args_t *args, int l, image_t *input, int *valid, int nvalid, lut_t *lut){
+int npar = lut->parameters.ncol;
+int nband = lut->simulations.ncol;
+table_stream_t parameters, simulations;
+float *par = NULL, *sim = NULL;
+float *sum = NULL;
+int *best = NULL;
+int n, row0 = 0, nchunk = 0;
+
+
+  // running best row and summed cost of each valid pixel, over all chunks
+  alloc((void**)&best, nvalid, sizeof(int));
+  alloc((void**)&sum,  nvalid, sizeof(float));
+  for (int v = 0; v < nvalid; v++) { best[v] = -1; sum[v] = FLT_MAX; }
+
+  alloc((void**)&par, (size_t)lut->chunk*npar,  sizeof(float));
+  alloc((void**)&sim, (size_t)lut->chunk*nband, sizeof(float));
+
+  parameters  = open_table_stream(args->lut_path[l], false, false);
+  simulations = open_table_stream(args->simulation_path[l], false, false);
+
+  while ((n = read_table_chunk(&simulations, sim, lut->chunk)) > 0) {
+
+    if (read_table_chunk(&parameters, par, n) != n) {
+      printf("LUT and simulations have different number of rows (%ld vs %ld)\n", 
+        parameters.nrow, simulations.nrow);
+      exit(FAILURE);
+    }
+
+    load_search(&lut->search, sim, n);
+
+    for (int r = 0; r < n; r++) {
+      for (int o = 0; o < npar; o++) {
+        if (par[r*npar+o] < lut->parameters.min[o]) lut->parameters.min[o] = par[r*npar+o];
+        if (par[r*npar+o] > lut->parameters.max[o]) lut->parameters.max[o] = par[r*npar+o];
+      }
+    }
+
+    // each chunk is applied to all pixels before the next one is read
+    #pragma omp parallel shared(input, valid, nvalid, lut, par, best, sum, n, row0, npar, nband)
+    {
+
+    short *keys = NULL;
+    float *pixels = NULL;
+    alloc((void**)&keys,   (size_t)BLOCK_CELLS*nband, sizeof(short));
+    alloc((void**)&pixels, (size_t)BLOCK_CELLS*nband, sizeof(float));
+
+    #pragma omp for schedule(dynamic)
+    for (int v0 = 0; v0 < nvalid; v0 += BLOCK_CELLS) {
+
+      int npix = (nvalid - v0 < BLOCK_CELLS) ? nvalid - v0 : BLOCK_CELLS;
+
+      for (int b = 0; b < nband; b++) {
+        short *band = input->image[b];
+        for (int p = 0; p < npix; p++) keys[p*nband+b] = band[valid[v0+p]];
+      }
+
+      for (int p = 0; p < npix; p++) search_transform(&lut->search, keys + p*nband, pixels + p*nband);
+
+      search_blocked_running(&lut->search, pixels, npix, row0, best + v0, sum + v0);
+
+      // parameters are only available while their chunk is in memory
+      for (int p = 0; p < npix; p++) {
+        if (best[v0+p] < row0) continue;
+        float *row = par + (size_t)(best[v0+p]-row0)*npar;
+        for (int o = 0; o < npar; o++) lut->inversion[o][valid[v0+p]] = row[o];
+      }
+
+    }
+
+    free((void*)keys);
+    free((void*)pixels);
+
+    }
+
+    row0 += n;
+    nchunk++;
+
+  }
+
+  if (read_table_chunk(&parameters, par, 1) > 0) {
+    printf("LUT and simulations have different number of rows (%ld vs %ld)\n", 
+      parameters.nrow, simulations.nrow);
+    exit(FAILURE);
+  }
+
+  // cost in additional band
+  for (int v = 0; v < nvalid; v++) {
+    if (best[v] < 0) continue;
+    lut->rows[valid[v]] = best[v];
+    lut->inversion[npar][valid[v]] = cost_from_sum(args->metric, sum[v], nband);
+  }
+
+  printf("streamed %d LUT rows in %d chunks\n", row0, nchunk);
+
+  close_table_stream(&parameters);
+  close_table_stream(&simulations);
+
+  free((void*)best);
+  free((void*)sum);
+  free((void*)par);
+  free((void*)sim);
+
+  return;
+}
+
+
+void write_output(char *path, image_t *input, lut_t *lut, GDALDataType datatype, char *exe){
+  GDALDatasetH output_dataset = NULL;
+  GDALRasterBandH output_band = NULL;
+  GDALDriverH output_driver = NULL;
+  char **output_options = NULL;
+  float **inversion = lut->inversion;
+  float *cost = inversion[lut->nout-1];
+  int npar = lut->parameters.ncol;
+  void *quantized = NULL;
+
+  if ((output_driver = GDALGetDriverByName("GTiff")) == NULL) {
+    printf("%s driver not found\n", "GTiff"); 
+    usage(exe, FAILURE);
+  }
+
+  output_options = CSLSetNameValue(output_options, "COMPRESS", "ZSTD");
+  output_options = CSLSetNameValue(output_options, "PREDICTOR", (datatype == GDT_Float32) ? "3" : "2");
+  output_options = CSLSetNameValue(output_options, "BIGTIFF", "YES");
+  //output_options = CSLSetNameValue(output_options, "OVERVIEWS", "NONE");
+
+
+  if ((output_dataset = GDALCreate(output_driver, path, input->ncol, input->nrow, lut->nout, datatype, output_options)) == NULL) {
+    printf("Error creating file %s.\n", path);
+    usage(exe, FAILURE);
+  }
+
+  if (datatype != GDT_Float32) alloc((void**)&quantized, input->ncell, sizeof(short));
+
+  // parameters, followed by the cost in an additional band
+  for (int o = 0; o < lut->nout; o++) {
+
+    output_band = GDALGetRasterBand(output_dataset, o+1);
+
+    if (datatype == GDT_Float32) {
+
+      GDALSetRasterNoDataValue(output_band, -1.0);
+
+      if (GDALRasterIO(output_band, GF_Write, 0, 0, input->ncol, input->nrow, 
+        inversion[o], input->ncol, input->nrow, GDT_Float32, 0, 0) == CE_Failure){
+        printf("Unable to write band %d in %s.\n", o+1, path); 
+        usage(exe, FAILURE);
+      }
+
+      continue;
+
+    }
+
+    // parameters span the LUT range, their spread at most its width
+    double lo = 0, hi = 0;
+
+    if (o < npar) {
+      lo = lut->parameters.min[o];
+      hi = lut->parameters.max[o];
+    } else if (o < lut->nout-1) {
+      hi = lut->parameters.max[o-npar] - lut->parameters.min[o-npar];
+    } else {
+      for (int c = 0; c < input->ncell; c++) if (cost[c] > hi) hi = cost[c];
+    }
+
+    int qmin   = (datatype == GDT_Int16) ? -SHRT_MAX : 0;
+    int qmax   = (datatype == GDT_Int16) ?  SHRT_MAX : USHRT_MAX-1;
+    int nodata = (datatype == GDT_Int16) ?  SHRT_MIN : USHRT_MAX;
+    double scale  = (hi > lo) ? (hi - lo) / (qmax - qmin) : 1;
+    double offset = lo - scale*qmin;
+
+    for (int c = 0; c < input->ncell; c++) {
+
+      long q = nodata;
+
+      if (cost[c] >= 0) {
+        q = lround((inversion[o][c] - offset) / scale);
+        if (q < qmin) q = qmin;
+        if (q > qmax) q = qmax;
+      }
+
+      if (datatype == GDT_Int16) {
+        ((short*)quantized)[c] = (short)q;
+      } else {
+        ((unsigned short*)quantized)[c] = (unsigned short)q;
+      }
+
+    }
+
+    GDALSetRasterNoDataValue(output_band, nodata);
+    GDALSetRasterScale(output_band, scale);
+    GDALSetRasterOffset(output_band, offset);
+
+    if (GDALRasterIO(output_band, GF_Write, 0, 0, input->ncol, input->nrow, 
+      quantized, input->ncol, input->nrow, datatype, 0, 0) == CE_Failure){
+      printf("Unable to write band %d in %s.\n", o+1, path); 
+      usage(exe, FAILURE);
+    }
+
+  }
+
+
+  GDALSetGeoTransform(output_dataset, input->geotransformation);
+  GDALSetProjection(output_dataset,   input->projection);
+
+  GDALClose(output_dataset);
+
+  if (output_options != NULL) CSLDestroy(output_options);
+  if (quantized != NULL) free(quantized);
+
+  return;
+}
+
+
+void write_index(char *path, image_t *input, lut_t *lut, char *lut_path, int metric, char *exe){
+  GDALDatasetH output_dataset = NULL;
+  GDALRasterBandH output_band = NULL;
+  GDALDriverH output_driver = NULL;
+  GDALRasterAttributeTableH rat = NULL;
+  char **output_options = NULL;
+  char value[STRLEN];
+  float *cost = lut->inversion[lut->nout-1];
+  int *index = NULL;
+  double max = 0, scale = 1;
+
+  if ((output_driver = GDALGetDriverByName("GTiff")) == NULL) {
+    printf("%s driver not found\n", "GTiff"); 
+    usage(exe, FAILURE);
+  }
+
+  output_options = CSLSetNameValue(output_options, "COMPRESS", "ZSTD");
+  output_options = CSLSetNameValue(output_options, "PREDICTOR", "2");
+  output_options = CSLSetNameValue(output_options, "BIGTIFF", "YES");
+
+  if ((output_dataset = GDALCreate(output_driver, path, input->ncol, input->nrow, 2, GDT_Int32, output_options)) == NULL) {
+    printf("Error creating file %s.\n", path);
+    usage(exe, FAILURE);
+  }
+
+  alloc((void**)&index, input->ncell, sizeof(int));
+
+  // best LUT row, rows of earlier dates are not written
+  for (int c = 0; c < input->ncell; c++) index[c] = (cost[c] < 0) ? -1 : lut->rows[c];
+
+  output_band = GDALGetRasterBand(output_dataset, 1);
+  GDALSetRasterNoDataValue(output_band, -1);
+  GDALSetDescription(output_band, "LUT row");
+
+  if (GDALRasterIO(output_band, GF_Write, 0, 0, input->ncol, input->nrow, 
+    index, input->ncol, input->nrow, GDT_Int32, 0, 0) == CE_Failure){
+    printf("Unable to write band %d in %s.\n", 1, path); 
+    usage(exe, FAILURE);
+  }
+
+  // the parameters of small LUTs are attached, GTiff writes the attribute
+  // table as xml sidecar. Streamed and large LUTs are only referenced
+  if (lut->chunk == 0 && lut->parameters.nrow <= INDEX_RAT_ROWS) {
+
+    rat = GDALCreateRasterAttributeTable();
+
+    for (int o = 0; o < lut->parameters.ncol; o++) {
+      snprintf(value, STRLEN, "parameter_%d", o+1);
+      GDALRATCreateColumn(rat, value, GFT_Real, GFU_Generic);
+    }
+
+    GDALRATSetRowCount(rat, lut->parameters.nrow);
+
+    for (int r = 0; r < lut->parameters.nrow; r++) {
+      for (int o = 0; o < lut->parameters.ncol; o++) GDALRATSetValueAsDouble(rat, r, o, table_get(&lut->parameters, r, o));
+    }
+
+    GDALSetDefaultRAT(output_band, rat);
+    GDALDestroyRasterAttributeTable(rat);
+
+  }
+
+  // cost, scaled to the full Int32 range
+  for (int c = 0; c < input->ncell; c++) {
+    if (cost[c] > max) max = cost[c];
+  }
+  if (max > 0) scale = max / (INT_MAX - 1);
+
+  for (int c = 0; c < input->ncell; c++) index[c] = (cost[c] < 0) ? -1 : (int)(cost[c]/scale + 0.5);
+
+  output_band = GDALGetRasterBand(output_dataset, 2);
+  GDALSetRasterNoDataValue(output_band, -1);
+  GDALSetRasterScale(output_band, scale);
+  GDALSetRasterOffset(output_band, 0);
+  GDALSetDescription(output_band, cost_name(metric));
+
+  if (GDALRasterIO(output_band, GF_Write, 0, 0, input->ncol, input->nrow, 
+    index, input->ncol, input->nrow, GDT_Int32, 0, 0) == CE_Failure){
+    printf("Unable to write band %d in %s.\n", 2, path); 
+    usage(exe, FAILURE);
+  }
+
+  // rtm-expand may run in another directory
+  absolutepath(lut_path, value, STRLEN);
+  GDALSetMetadataItem(output_dataset, "LUT", value, "RTM");
+  snprintf(value, STRLEN, "%d", lut->parameters.ncol);
+  GDALSetMetadataItem(output_dataset, "LUT_PARAMETERS", value, "RTM");
+
+
+  GDALSetGeoTransform(output_dataset, input->geotransformation);
+  GDALSetProjection(output_dataset,   input->projection);
+
+  GDALClose(output_dataset);
+
+  if (output_options != NULL) CSLDestroy(output_options);
+  free((void*)index);
+
+  return;
+}
+
+
+float *parse_weights(char *list, int nband, char *exe){
+char buffer[STRLEN];
+char *ptr = NULL, *saveptr = NULL;
+float *weight = NULL;
+int n = 0;
+
+
+  alloc((void**)&weight, nband, sizeof(float));
+
+  copy_string(buffer, STRLEN, list);
+
+  for (ptr = strtok_r(buffer, ",", &saveptr); ptr != NULL; ptr = strtok_r(NULL, ",", &saveptr)) {
+    if (n == nband || char_to_float(ptr, &weight[n]) == FAILURE || weight[n] < 0) {
+      fprintf(stderr, "-W needs %d non-negative weights (%s)\n", nband, list);
+      usage(exe, FAILURE);
+    }
+    n++;
+  }
+
+  if (n != nband) {
+    fprintf(stderr, "-W needs %d non-negative weights (%s)\n", nband, list);
+    usage(exe, FAILURE);
+  }
+
+  return weight;
+}
+
+
+void read_lut_stream(args_t *args, int l, lut_t *lut, char *exe){
+table_stream_t parameters, simulations;
+
+
+  parameters  = open_table_stream(args->lut_path[l], false, false);
+  simulations = open_table_stream(args->simulation_path[l], false, false);
+
+  memset(&lut->parameters,  0, sizeof(table_t));
+  memset(&lut->simulations, 0, sizeof(table_t));
+  lut->parameters.ncol  = parameters.ncol;
+  lut->simulations.ncol = simulations.ncol;
+
+  // the parameter range is only known after the first pass over the LUT
+  alloc((void**)&lut->parameters.min, lut->parameters.ncol, sizeof(double));
+  alloc((void**)&lut->parameters.max, lut->parameters.ncol, sizeof(double));
+  for (int o = 0; o < lut->parameters.ncol; o++) {
+    lut->parameters.min[o] =  DBL_MAX;
+    lut->parameters.max[o] = -DBL_MAX;
+  }
+
+  close_table_stream(&parameters);
+  close_table_stream(&simulations);
+
+  if (lut->parameters.ncol < 1 || lut->simulations.ncol < 1) {
+    fprintf(stderr, "LUT or simulations are empty (%s, %s)\n", args->lut_path[l], args->simulation_path[l]);
+    usage(exe, FAILURE);
+  }
+
+  // raw parameters and spectra of one chunk, plus the transformed spectra
+  size_t row_bytes = (size_t)(lut->parameters.ncol + 2*lut->simulations.ncol)*sizeof(float);
+  double chunk = (double)args->budget*1048576.0 / row_bytes;
+  lut->chunk = (chunk > INT_MAX) ? INT_MAX : (chunk < 1) ? 1 : (int)chunk;
+
+  float *weight = NULL;
+
+  if (strcmp(args->weights, "NULL") != 0) {
+    weight = parse_weights(args->weights, lut->simulations.ncol, exe);
+  }
+
+  lut->search = allocate_search(lut->chunk, lut->simulations.ncol, args->metric, weight);
+
+  printf("LUT: %s, %d parameters, %d bands\n", args->lut_path[l], lut->parameters.ncol, lut->simulations.ncol);
+  printf("streamed in chunks of %d rows (%.2f MB)\n", lut->chunk, (double)lut->chunk*row_bytes / 1048576.0);
+  printf("cost function: %s%s\n", cost_name(args->metric), (weight != NULL) ? ", weighted" : "");
+  printf("\n");
+
+  if (weight != NULL) free((void*)weight);
+
+  lut->strategy = _SEARCH_BLOCKED_;
+  lut->caches = NULL;
+  lut->nout = lut->parameters.ncol+1;
+  lut->rows = NULL;
+  lut->inversion = NULL;
+
+  return;
+}
+
+
+// bands that are used for the inversion become the active columns of
+// the simulations, in the order of the simulations
+void select_bands(char *list, table_t *simulations, char *exe){
+char buffer[STRLEN];
+char *ptr = NULL, *saveptr = NULL;
+int band;
+
+
+  if (strcmp(list, "NULL") == 0) return;
+
+  memset(simulations->col_mask, 0, simulations->ncol*sizeof(bool));
+  simulations->n_active_cols = 0;
+
+  copy_string(buffer, STRLEN, list);
+
+  for (ptr = strtok_r(buffer, ",", &saveptr); ptr != NULL; ptr = strtok_r(NULL, ",", &saveptr)) {
+    if (char_to_int(ptr, &band) == FAILURE || band < 1 || band > simulations->ncol || simulations->col_mask[band-1]) {
+      fprintf(stderr, "-b needs distinct bands within 1 and %d (%s)\n", simulations->ncol, list);
+      usage(exe, FAILURE);
+    }
+    simulations->col_mask[band-1] = true;
+    simulations->n_active_cols++;
+  }
+
+  if (simulations->n_active_cols == 0) {
+    fprintf(stderr, "-b needs at least one band (%s)\n", list);
+    usage(exe, FAILURE);
+  }
+
+  return;
+}
+
+
+// position of a band among the selected bands, or -1
+int selected_band(const table_t *simulations, int band){
+int position = 0;
+
+
+  if (band < 0 || band >= simulations->ncol || !simulations->col_mask[band]) return -1;
+
+  for (int b = 0; b < band; b++) position += simulations->col_mask[b];
+
+  return position;
+}
+
+
+// band of the simulations at a position among the selected bands
+int simulation_band(const table_t *simulations, int position){
+
+  for (int b = 0; b < simulations->ncol; b++) {
+    if (simulations->col_mask[b] && position-- == 0) return b;
+  }
+
+  return -1;
+}
+
+
+// search structures of a LUT, or of a class slice of a LUT. searched holds
+// the spectra of the selected bands, simulations the band selection
+void prepare_lut(args_t *args, lut_t *lut, table_t *searched, const table_t *simulations, const float *weight, char *exe){
+
+
+  // normalization and weights are folded into the LUT once, a compiled LUT
+  // may hold the spectra in this transform, these are then used in place
+  if (searched == simulations && lut->file.search.spec != NULL) {
+    lut->search = prepare_shared_search(searched, args->metric, args->zscore, weight, &lut->file.search);
+  } else {
+    lut->search = prepare_search(searched, args->metric, args->zscore, weight);
+  }
+
+  if (lut->file.map != NULL) {
+    printf("search spectra: %s\n", lut->search.shared ? "mapped from the compiled LUT" :
+      "copied, the compiled LUT holds them for other -f, -z, -W or -b");
+    printf("\n");
+  }
+
+  // a forced strategy is used as is, auto prepares all candidates
+  int strategy = lut->strategy = args->strategy;
+
+  // sampling without replacement over a stratified order of the LUT,
+  // a compiled LUT may hold the order already
+  if (strategy == _SEARCH_SAMPLE_ || (strategy == _SEARCH_AUTO_ && args->accuracy > FLT_EPSILON)) {
+    if (lut->file.order != NULL) {
+      alloc((void**)&lut->search.order, lut->search.nrow, sizeof(int));
+      for (int r = 0; r < lut->search.nrow; r++) lut->search.order[r] = lut->file.order[r];
+    } else {
+      prepare_sampling(&lut->search, &lut->parameters);
+    }
+  }
+
+  if (strategy == _SEARCH_PREFILTER_ || (strategy == _SEARCH_AUTO_ && lut->search.nband > 1)) {
+
+    int band1 = args->prefilter[0], band2 = args->prefilter[1];
+
+    if (band1 >= simulations->ncol || band2 >= simulations->ncol) {
+      fprintf(stderr, "prefilter bands exceed number of bands (%d)\n", simulations->ncol);
+      usage(exe, FAILURE);
+    }
+
+    // the prefilter of a compiled LUT is used if it has the bands
+    if (band1 < 0 && lut->search.shared_prefilter) {
+      band1 = lut->search.band1;
+      band2 = lut->search.band2;
+    } else if (band1 < 0) {
+      suggest_prefilter(&lut->search, &band1, &band2);
+    } else if ((band1 = selected_band(simulations, band1)) < 0 || 
+               (band2 = selected_band(simulations, band2)) < 0) {
+      fprintf(stderr, "prefilter bands need to be selected with -b\n");
+      usage(exe, FAILURE);
+    }
+
+    if (!lut->search.shared_prefilter || band1 != lut->search.band1 || band2 != lut->search.band2) {
+      prepare_prefilter(&lut->search, band1, band2);
+    }
+
+    printf("prefilter: band %d - band %d, %s%s\n", simulation_band(simulations, band2)+1, 
+      simulation_band(simulations, band1)+1, (args->tolerance > 0) ? "approximate" : "exact",
+      lut->search.shared_prefilter ? ", mapped from the compiled LUT" : "");
+    printf("\n");
+
+  }
+
+  if (strategy == _SEARCH_IVF_ || (strategy == _SEARCH_AUTO_ && args->nlist > 0)) {
+
+    int nlist = (args->nlist > 0) ? args->nlist : (int)sqrt(lut->search.nrow);
+
+    double t0 = omp_get_wtime();
+    lut->ivf = build_ivf(lut->search.spec, lut->search.nrow, lut->search.nband, nlist, 10, args->metric);
+
+    printf("approximate search: %d clusters, %d probed\n", lut->ivf.nlist, args->nprobe);
+    printf("index build time: %.3f s\n", omp_get_wtime() - t0);
+    printf("index memory: %.2f MB\n", ivf_memory(&lut->ivf) / 1048576.0);
+    printf("\n");
+
+  }
+
+  // caches persist across dates, a spectrum is only searched once per thread
+  int nthread = omp_get_max_threads();
+  alloc((void**)&lut->caches, nthread, sizeof(cache_t));
+  if (args->ncache > 0) {
+    for (int t = 0; t < nthread; t++) lut->caches[t] = allocate_cache(args->ncache, lut->search.nband, args->k);
+  }
+
+  return;
+}
+
+
+// the LUT rows of each class are compacted into a slice with its own search
+// structures, so that pixels are only compared with the rows of their class.
+// z-scores are based on the whole LUT, so that all classes share the scale
+void slice_lut(args_t *args, int l, lut_t *lut, const float *weight, char *exe){
+table_t classes;
+int *value = NULL;
+int nrow = lut->parameters.nrow;
+
+
+  classes = read_table(args->lut_class_path[l], false, false);
+
+  if (classes.nrow != nrow || classes.ncol != 1) {
+    fprintf(stderr, "%s needs one class per LUT row (%d x %d, expected %d x 1)\n", 
+      args->lut_class_path[l], classes.nrow, classes.ncol, nrow);
+    usage(exe, FAILURE);
+  }
+
+  alloc((void**)&value, nrow, sizeof(int));
+  alloc((void**)&lut->classes, nrow, sizeof(int));
+
+  for (int r = 0; r < nrow; r++) value[r] = lut->classes[r] = (int)table_get(&classes, r, 0);
+
+  free_table(&classes);
+
+  // distinct classes in ascending order
+  qsort(lut->classes, nrow, sizeof(int), cmp_int);
+
+  lut->nclass = 0;
+  for (int r = 0; r < nrow; r++) {
+    if (lut->nclass == 0 || lut->classes[r] != lut->classes[lut->nclass-1]) lut->classes[lut->nclass++] = lut->classes[r];
+  }
+
+  alloc((void**)&lut->slices, lut->nclass, sizeof(lut_t));
+  alloc((void**)&lut->start, lut->nclass+1, sizeof(int));
+
+  printf("LUT classes: %d (%s)\n", lut->nclass, args->lut_class_path[l]);
+  printf("\n");
+
+
+  for (int s = 0; s < lut->nclass; s++) {
+
+    lut_t *slice = &lut->slices[s];
+    table_t searched;
+    int n = 0;
+
+    // rows of this class are the active rows of the LUT
+    for (int r = 0; r < nrow; r++) {
+      lut->parameters.row_mask[r] = lut->simulations.row_mask[r] = (value[r] == lut->classes[s]);
+      n += lut->parameters.row_mask[r];
+    }
+    lut->parameters.n_active_rows = lut->simulations.n_active_rows = n;
+
+    alloc((void**)&slice->map, n, sizeof(int));
+    for (int r = 0, i = 0; r < nrow; r++) {
+      if (value[r] == lut->classes[s]) slice->map[i++] = r;
+    }
+
+    slice->parameters = compact_table(&lut->parameters);
+    searched = compact_table(&lut->simulations);
+
+    for (int b = 0; b < lut->simulations.ncol; b++) {
+      int position = selected_band(&lut->simulations, b);
+      if (position < 0) continue;
+      searched.mean[position] = lut->simulations.mean[b];
+      searched.sd[position]   = lut->simulations.sd[b];
+    }
+
+    printf("class %d: %d LUT rows\n", lut->classes[s], n);
+    printf("\n");
+
+    prepare_lut(args, slice, &searched, &lut->simulations, weight, exe);
+
+    free_table(&searched);
+
+  }
+
+  memset(lut->parameters.row_mask,  1, nrow*sizeof(bool));
+  memset(lut->simulations.row_mask, 1, nrow*sizeof(bool));
+  lut->parameters.n_active_rows = lut->simulations.n_active_rows = nrow;
+
+  free((void*)value);
+
+  // the whole LUT is not searched
+  memset(&lut->search, 0, sizeof(search_t));
+  memset(&lut->ivf, 0, sizeof(ivf_t));
+  lut->strategy = args->strategy;
+  lut->caches = NULL;
+
+  return;
+}
+
+
+void read_lut(args_t *args, int l, lut_t *lut, char *exe){
+bool compiled = is_lutfile(args->lut_path[l]);
+
+
+  lut->chunk = 0;
+  memset(&lut->file, 0, sizeof(lutfile_t));
+
+  lut->map = NULL;
+  lut->nclass = 0;
+  lut->classes = NULL;
+  lut->slices = NULL;
+  lut->start = NULL;
+  lut->cells = NULL;
+
+  if (compiled && args->n_simulation > 0) {
+    fprintf(stderr, "%s is a compiled LUT, it holds the simulations (omit -s)\n", args->lut_path[l]);
+    usage(exe, FAILURE);
+  }
+
+  if (!compiled && args->n_simulation == 0) {
+    fprintf(stderr, "%s needs simulations (-s), or compile it with rtm-lut-compile\n", args->lut_path[l]);
+    usage(exe, FAILURE);
+  }
+
+  if (compiled && args->budget > 0) {
+    fprintf(stderr, "-M cannot be used with the compiled LUT %s, it is mapped into memory\n", args->lut_path[l]);
+    usage(exe, FAILURE);
+  }
+
+  // the LUT is only opened to get its dimensions, it is read per chunk later
+  if (args->budget > 0) {
+    read_lut_stream(args, l, lut, exe);
+    return;
+  }
+
+  // the tables of a compiled LUT are views of the mapped columns
+  if (compiled) {
+
+    lut->file = open_lutfile(args->lut_path[l]);
+    lut->parameters  = lutfile_parameters(&lut->file);
+    lut->simulations = lutfile_simulations(&lut->file);
+
+    printf("compiled LUT: %s\n", args->lut_path[l]);
+    printf("\n");
+
+  } else {
+
+    lut->parameters  = read_table(args->lut_path[l], false, false);
+    lut->simulations = read_table(args->simulation_path[l], false, false);
+
+    if (lut->parameters.nrow != lut->simulations.nrow) {
+      fprintf(stderr, "LUT and simulations have different number of rows (%d vs %d)\n", 
+        lut->parameters.nrow, lut->simulations.nrow);
+      usage(exe, FAILURE);
+    }
+
+  }
+
+  print_table(&lut->parameters, true, false);
+  print_table(&lut->simulations, true, false);
+
+  select_bands(args->bands, &lut->simulations, exe);
+
+  float *weight = NULL;
+
+  // weights are given for all bands, and kept for the selected ones
+  if (strcmp(args->weights, "NULL") != 0) {
+    weight = parse_weights(args->weights, lut->simulations.ncol, exe);
+    for (int b = 0, n = 0; b < lut->simulations.ncol; b++) {
+      if (lut->simulations.col_mask[b]) weight[n++] = weight[b];
+    }
+  }
+
+  printf("cost function: %s%s%s\n", cost_name(args->metric), 
+    args->zscore ? ", z-scores" : "", (weight != NULL) ? ", weighted" : "");
+  if (lut->simulations.n_active_cols < lut->simulations.ncol) {
+    printf("bands: %d of %d selected\n", lut->simulations.n_active_cols, lut->simulations.ncol);
+  }
+  printf("\n");
+
+  // the search only holds the selected bands
+  if (args->n_class > 0) {
+
+    slice_lut(args, l, lut, weight, exe);
+
+  } else {
+
+    table_t compact, *searched = &lut->simulations;
+
+    if (lut->simulations.n_active_cols < lut->simulations.ncol) {
+      compact = compact_table(&lut->simulations);
+      searched = &compact;
+    }
+
+    prepare_lut(args, lut, searched, &lut->simulations, weight, exe);
+
+    if (searched != &lut->simulations) free_table(&compact);
+
+  }
+
+  if (weight != NULL) free((void*)weight);
+
+  // parameters (and their spread) plus cost
+  lut->nout = (args->k > 1) ? 2*lut->parameters.ncol+1 : lut->parameters.ncol+1;
+
+  lut->rows = NULL;
+  lut->inversion = NULL;
+
+  return;
+}
+
+
+void free_lut(args_t *args, lut_t *lut){
+int nthread = omp_get_max_threads();
+bool slice = (lut->map != NULL);
+
+
+  // slices share the rows and outputs of their LUT
+  for (int s = 0; s < lut->nclass; s++) {
+    lut->slices[s].rows = NULL;
+    free_lut(args, &lut->slices[s]);
+  }
+  if (lut->slices  != NULL) free((void*)lut->slices);
+  if (lut->classes != NULL) free((void*)lut->classes);
+  if (lut->start   != NULL) free((void*)lut->start);
+  if (lut->map     != NULL) free((void*)lut->map);
+
+  if (args->ncache > 0 && lut->caches != NULL) {
+    for (int t = 0; t < nthread; t++) free_cache(&lut->caches[t]);
+  }
+  if (lut->caches != NULL) free((void*)lut->caches);
+  if (lut->rows != NULL) free((void*)lut->rows);
+
+  // streamed LUTs hold no tables, only the parameter range
+  if (lut->chunk == 0) {
+    free_table(&lut->parameters);
+    if (!slice) free_table(&lut->simulations); // slices hold no spectra
+    if (lut->file.map != NULL) close_lutfile(&lut->file);
+  } else {
+    free((void*)lut->parameters.min);
+    free((void*)lut->parameters.max);
+  }
+
+  free_search(&lut->search);
+  if (lut->ivf.nlist > 0) free_ivf(&lut->ivf);
+
+  return;
+}
+
+
+void output_name(char *output_path, char *lut_path, char *path, int size){
+char dname[STRLEN];
+char bname[STRLEN];
+char lname[STRLEN];
+char ext[STRLEN];
+char tmp[STRLEN];
+
+
+  directoryname(output_path, dname, STRLEN);
+  basename_without_ext(output_path, bname, STRLEN);
+  extension(output_path, ext, STRLEN);
+  basename_without_ext(lut_path, lname, STRLEN);
+
+  concat_string_2(tmp, STRLEN, bname, lname, "_");
+  concat_string_2(path, size, dname, tmp, "/");
+  if (strlen(path) + strlen(ext) >= (size_t)size) {
+    printf("Buffer Overflow in assembling string\n"); 
+    exit(FAILURE);
+  }
+  strcat(path, ext);
+
+  return;
+}
+
+
+int main ( int argc, char *argv[] ){
+
+
+args_t args;
+lut_t *luts = NULL;
+
+  parse_args(argc, argv, &args);
+
+
+  // all LUTs are prepared up front, and searched in one pass over each image
+  alloc((void**)&luts, args.n_lut, sizeof(lut_t));
+
+  for (int l = 0; l < args.n_lut; l++) {
+    read_lut(&args, l, &luts[l], argv[0]);
+    if (luts[l].simulations.ncol != luts[0].simulations.ncol) {
+      fprintf(stderr, "number of simulated bands differs between LUTs (%d vs %d)\n", 
+        luts[l].simulations.ncol, luts[0].simulations.ncol);
+      usage(argv[0], FAILURE);
+    }
+  }
+
+  GDALAllRegister();
+
+  int nrow = 0, ncol = 0, ncell = 0;
+  int nband = luts[0].simulations.ncol;
+  bool *select = luts[0].simulations.col_mask;
+
+
+  // dates are inverted in the order given, with the same LUTs
+  for (int d = 0; d < args.n_input; d++) {
+
+    image_t input;
+
+    read_input(args.input_path[d], &input, nband, select, argv[0]);
+
+    if (args.temporal && d > 0 && (input.nrow != nrow || input.ncol != ncol)) {
+      fprintf(stderr, "dimensions of %s (%d x %d) differ from first date (%d x %d)\n", 
+        args.input_path[d], input.nrow, input.ncol, nrow, ncol);
+      usage(argv[0], FAILURE);
+    }
+
+    for (int l = 0; l < args.n_lut; l++) {
+
+      if (d == 0) {
+        alloc((void**)&luts[l].rows, input.ncell, sizeof(int));
+        for (int c = 0; c < input.ncell; c++) luts[l].rows[c] = -1;
+      } else if (input.ncell > ncell) {
+        re_alloc((void**)&luts[l].rows, ncell, input.ncell, sizeof(int));
+      }
+
+      // without temporal warm start, each date starts from scratch
+      if (!args.temporal) {
+        for (int c = 0; c < input.ncell; c++) luts[l].rows[c] = -1;
+      }
+
+      alloc_2D((void***)&luts[l].inversion, luts[l].nout, input.ncell, sizeof(float));
+
+      // store -1.0 for nodata, including mae in addtional band
+      for (int o = 0; o < luts[l].nout; o++) {
+        for (int c = 0; c < input.ncell; c++) luts[l].inversion[o][c] = -1.0;
+      }
+
+      // class slices write into the outputs of their LUT
+      for (int s = 0; s < luts[l].nclass; s++) {
+        luts[l].slices[s].rows      = luts[l].rows;
+        luts[l].slices[s].inversion = luts[l].inversion;
+        luts[l].slices[s].nout      = luts[l].nout;
+      }
+
+    }
+
+    if (d == 0) { nrow = input.nrow; ncol = input.ncol; }
+    if (input.ncell > ncell) ncell = input.ncell;
+
+
+    // dense list of valid cells, nodata cells are never visited again
+    int *valid = NULL;
+    alloc((void**)&valid, input.ncell, sizeof(int));
+    int nvalid = compact_valid(&input, valid);
+
+    printf("valid pixels: %d of %d (%.1f%%)\n", nvalid, input.ncell, 100.0*nvalid/input.ncell);
+    printf("\n");
+
+    // only pixels that differ from the previous input are inverted
+    bool *unchanged = NULL;
+
+    if (strcmp(args.previous_input, "NULL") != 0) {
+
+      image_t previous;
+
+      read_input(args.previous_input, &previous, nband, select, argv[0]);
+
+      if (previous.nrow != input.nrow || previous.ncol != input.ncol) {
+        fprintf(stderr, "dimensions of %s (%d x %d) differ from input (%d x %d)\n", 
+          args.previous_input, previous.nrow, previous.ncol, input.nrow, input.ncol);
+        usage(argv[0], FAILURE);
+      }
+
+      alloc((void**)&unchanged, input.ncell, sizeof(bool));
+      nvalid = changed_valid(&input, &previous, valid, nvalid, unchanged);
+
+      free_2D((void**)previous.image, previous.nband);
+
+    }
+
+    // valid cells are grouped by the class slices of each LUT
+    int *classes = NULL;
+
+    if (args.n_class > 0) {
+
+      classes = read_classes(args.class_path, &input, argv[0]);
+
+      for (int l = 0; l < args.n_lut; l++) {
+        int ngroup = group_classes(&luts[l], classes, valid, nvalid);
+        printf("pixels with LUT rows of their class: %d of %d (%s)\n", ngroup, nvalid, args.lut_path[l]);
+      }
+      printf("\n");
+
+    }
+
+    for (int l = 0; l < args.n_lut && d == 0 && args.budget <= 0; l++) {
+
+      if (luts[l].nclass == 0) {
+        plan_lut(&args, &luts[l], &input, valid, nvalid);
+        continue;
+      }
+
+      for (int s = 0; s < luts[l].nclass; s++) {
+        printf("class %d:\n", luts[l].classes[s]);
+        plan_lut(&args, &luts[l].slices[s], &input, luts[l].cells + luts[l].start[s], luts[l].start[s+1] - luts[l].start[s]);
+      }
+
+    }
+
+
+    double t0 = omp_get_wtime();
+    if (args.budget > 0) {
+      for (int l = 0; l < args.n_lut; l++) invert_stream(&args, l, &input, valid, nvalid, &luts[l]);
+    } else if (args.n_class > 0) {
+      for (int l = 0; l < args.n_lut; l++) {
+        for (int s = 0; s < luts[l].nclass; s++) {
+          invert(&args, &input, luts[l].cells + luts[l].start[s], luts[l].start[s+1] - luts[l].start[s], &luts[l].slices[s], 1);
+        }
+      }
+    } else {
+      invert(&args, &input, valid, nvalid, luts, args.n_lut);
+    }
+    printf("inversion time: %.3f s\n", omp_get_wtime() - t0);
+    printf("\n");
+
+    for (int l = 0; l < args.n_lut && unchanged != NULL; l++) {
+
+      char path[STRLEN];
+
+      if (args.n_lut > 1) {
+        output_name(args.previous_output, args.lut_path[l], path, STRLEN);
+      } else {
+        copy_string(path, STRLEN, args.previous_output);
+      }
+
+      copy_previous(path, &input, unchanged, &luts[l], argv[0]);
+
+    }
+
+    for (int l = 0; l < args.n_lut; l++) {
+
+      char path[STRLEN];
+
+      if (args.n_lut > 1) {
+        output_name(args.output_path[d], args.lut_path[l], path, STRLEN);
+      } else {
+        copy_string(path, STRLEN, args.output_path[d]);
+      }
+
+      if (args.index) {
+        write_index(path, &input, &luts[l], args.lut_path[l], args.metric, argv[0]);
+      } else {
+        write_output(path, &input, &luts[l], args.datatype, argv[0]);
+      }
+
+      free_2D((void**)luts[l].inversion, luts[l].nout);
+      luts[l].inversion = NULL;
+
+    }
+
+    free_2D((void**)input.image, input.nband);
+    free((void*)valid);
+    if (unchanged != NULL) free((void*)unchanged);
+    if (classes != NULL) free((void*)classes);
+
+    for (int l = 0; l < args.n_lut; l++) {
+      if (luts[l].cells != NULL) free((void*)luts[l].cells);
+      luts[l].cells = NULL;
+    }
+
+  }
+
+
+  if (args.ncache > 0) {
+
+    long cache_lookups = 0, cache_hits = 0;
+    size_t cache_bytes = 0;
+
+    for (int l = 0; l < args.n_lut; l++) {
+      for (int s = 0; s < luts[l].nclass || s == 0; s++) {
+        lut_t *lut = (luts[l].nclass > 0) ? &luts[l].slices[s] : &luts[l];
+        for (int t = 0; t < omp_get_max_threads(); t++) {
+          cache_lookups += lut->caches[t].lookups;
+          cache_hits    += lut->caches[t].hits;
+          cache_bytes   += cache_memory(&lut->caches[t]);
+        }
+      }
+    }
+
+    printf("spectral cache: %ld of %ld lookups hit (%.1f%%), %.2f MB\n", 
+      cache_hits, cache_lookups, (cache_lookups > 0) ? 100.0*cache_hits/cache_lookups : 0, cache_bytes / 1048576.0);
+    printf("\n");
+
+  }
+
+  for (int l = 0; l < args.n_lut; l++) free_lut(&args, &luts[l]);
+  free((void*)luts);
+
+  free_2DC((void**)args.lut_path);
+  free_2DC((void**)args.simulation_path);
+  free_2DC((void**)args.input_path);
+  free_2DC((void**)args.output_path);
+  free_2DC((void**)args.lut_class_path);
 
   return SUCCESS;
 
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+
+#include "utils/const.h"
+#include "utils/alloc.h"
+#include "utils/dir.h"
+#include "utils/string.h"
+#include "utils/table.h"
+#include "utils/search.h"
+#include "utils/lutfile.h"
+
+
+void usage(char *exe, int exit_code){
+
+  printf("\n");
+  printf("Usage: %s -l LUT.csv -s simulations.csv -o LUT.rlut [-I]\n", exe);
+  printf("       [-f mae] [-z] [-W 1,1,...] [-P] [-x red,nir]\n");
+  printf("  \n");
+  printf("  adapt file names\n");
+  printf("  -o compiled LUT, can be given to rtm-inversion -l without -s\n");
+  printf("   parameters and simulations are stored as float32 columns, together\n");
+  printf("   with their statistics. The file is mapped into memory when used\n");
+  printf("  -I include the stratified sampling order of the LUT rows (-S sample)\n");
+  printf("  -f, -z and -W as in rtm-inversion, the search spectra are stored in this\n");
+  printf("   transform. rtm-inversion searches them in place if it is run with the\n");
+  printf("   same -f, -z and -W, and without -b, so that processes on one node share\n");
+  printf("   them in the page cache. Otherwise, each process copies the spectra once\n");
+  printf("  -P include the prefilter of the search spectra (-S prefilter), for the\n");
+  printf("   bands of -x, or the band pair that rtm-inversion suggests without -x\n");
+  printf("\n");
+
+  exit(exit_code);
+  return;
+}
+
+typedef struct {
+  char lut_path[STRLEN];
+  char simulation_path[STRLEN];
+  char output_path[STRLEN];
+  bool order;
+  int metric;
+  bool zscore;
+  char weights[STRLEN];
+  bool prefilter;
+  int band[2];
+} args_t;
+
+
+void parse_args(int argc, char *argv[], args_t *args){
+int opt, received_n = 0, expected_n = 3;
+
+  opterr = 0;
+
+  args->order = false;
+  args->metric = COST_MAE;
+  args->zscore = false;
+  copy_string(args->weights, STRLEN, "NULL");
+  args->prefilter = false;
+  args->band[0] = args->band[1] = -1;
+
+  while ((opt = getopt(argc, argv, "l:s:o:If:zW:Px:")) != -1){
+    switch(opt){
+      case 'l':
+        copy_string(args->lut_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 's':
+        copy_string(args->simulation_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 'o':
+        copy_string(args->output_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 'I':
+        args->order = true;
+        break;
+      case 'f':
+        if ((args->metric = cost_metric(optarg)) < 0) {
+          fprintf(stderr, "unknown cost function %s\n", optarg);
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'z':
+        args->zscore = true;
+        break;
+      case 'W':
+        copy_string(args->weights, STRLEN, optarg);
+        break;
+      case 'P':
+        args->prefilter = true;
+        break;
+      case 'x':
+        if (sscanf(optarg, "%d,%d", &args->band[0], &args->band[1]) != 2 ||
+            args->band[0] < 1 || args->band[1] < 1) {
+          fprintf(stderr, "-x needs two bands, e.g. 3,4\n");
+          usage(argv[0], FAILURE);
+        }
+        args->band[0]--;
+        args->band[1]--;
+        args->prefilter = true;
+        break;
+      case '?':
+        if (isprint(optopt)){
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        usage(argv[0], FAILURE);
+      default:
+        fprintf(stderr, "Error parsing arguments.\n");
+        usage(argv[0], FAILURE);
+    }
+  }
+
+  if (received_n != expected_n) {
+    fprintf(stderr, "missing arguments\n");
+    usage(argv[0], FAILURE);
+  }
+
+  int n_input = argc-optind;
+
+  if (n_input > 0) {
+    fprintf(stderr, "too many parameters specified\n");
+    usage(argv[0], FAILURE);
+  }
+
+  return;
+}
+
+
+float *parse_weights(char *list, int nband, char *exe){
+char buffer[STRLEN];
+char *ptr = NULL, *saveptr = NULL;
+float *weight = NULL;
+int n = 0;
+
+
+  alloc((void**)&weight, nband, sizeof(float));
+
+  copy_string(buffer, STRLEN, list);
+
+  for (ptr = strtok_r(buffer, ",", &saveptr); ptr != NULL; ptr = strtok_r(NULL, ",", &saveptr)) {
+    if (n == nband || char_to_float(ptr, &weight[n]) == FAILURE || weight[n] < 0) {
+      fprintf(stderr, "-W needs %d non-negative weights (%s)\n", nband, list);
+      usage(exe, FAILURE);
+    }
+    n++;
+  }
+
+  if (n != nband) {
+    fprintf(stderr, "-W needs %d non-negative weights (%s)\n", nband, list);
+    usage(exe, FAILURE);
+  }
+
+  return weight;
+}
+
+
+int main ( int argc, char *argv[] ){
+
+
+args_t args;
+table_t parameters, simulations;
+search_t search;
+lutfile_t lut;
+
+
+  parse_args(argc, argv, &args);
+
+  parameters  = read_table(args.lut_path, false, false);
+  simulations = read_table(args.simulation_path, false, false);
+
+  if (parameters.nrow != simulations.nrow) {
+    fprintf(stderr, "LUT and simulations have different number of rows (%d vs %d)\n",
+      parameters.nrow, simulations.nrow);
+    usage(argv[0], FAILURE);
+  }
+
+  float *weight = NULL;
+  if (strcmp(args.weights, "NULL") != 0) weight = parse_weights(args.weights, simulations.ncol, argv[0]);
+
+  if (args.band[0] >= simulations.ncol || args.band[1] >= simulations.ncol) {
+    fprintf(stderr, "prefilter bands exceed number of bands (%d)\n", simulations.ncol);
+    usage(argv[0], FAILURE);
+  }
+
+  // the search spectra in the transform of rtm-inversion, the sampling 
+  // order only depends on the parameters
+  search = prepare_search(&simulations, args.metric, args.zscore, weight);
+
+  if (args.order) prepare_sampling(&search, &parameters);
+
+  if (args.prefilter && simulations.ncol > 1) {
+    if (args.band[0] < 0) suggest_prefilter(&search, &args.band[0], &args.band[1]);
+    prepare_prefilter(&search, args.band[0], args.band[1]);
+  }
+
+  write_lutfile(args.output_path, &parameters, &simulations, &search);
+
+  free_search(&search);
+
+
+  // read back, to make sure that the file can be used
+  lut = open_lutfile(args.output_path);
+
+  printf("compiled LUT: %s\n", args.output_path);
+  printf("version: %d\n", lut.header->version);
+  printf("rows: %ld\n", (long)lut.header->nrow);
+  printf("parameters: %d\n", lut.header->npar);
+  printf("bands: %d\n", lut.header->nband);
+  printf("sampling order: %s\n", (lut.order != NULL) ? "yes" : "no");
+  printf("search spectra: %s%s%s\n", cost_name(lut.search.metric), 
+    args.zscore ? ", z-scores" : "", (weight != NULL) ? ", weighted" : "");
+  if (lut.search.index != NULL) {
+    printf("prefilter: band %d - band %d\n", lut.search.band2+1, lut.search.band1+1);
+  } else {
+    printf("prefilter: no\n");
+  }
+  printf("size: %.2f MB\n", lut.size / 1048576.0);
+
+  close_lutfile(&lut);
+
+  free_table(&parameters);
+  free_table(&simulations);
+  if (weight != NULL) free((void*)weight);
+
+  return SUCCESS;
+
+}
+
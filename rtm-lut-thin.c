@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <ctype.h>
+
+
+#include "utils/const.h"
+#include "utils/alloc.h"
+#include "utils/string.h"
+#include "utils/table.h"
+#include "utils/search.h"
+
+
+void usage(char *exe, int exit_code){
+
+  printf("\n");
+  printf("Usage: %s -l LUT.csv -s simulations.csv -L LUT_thin.csv -S simulations_thin.csv\n", exe);
+  printf("       -e 10 [-f mae] [-z] [-W 1,1,...]\n");
+  printf("  \n");
+  printf("  adapt file names\n");
+  printf("  -L and -S receive the thinned LUT and simulations\n");
+  printf("  -e tolerance in units of the cost function\n");
+  printf("   a simulation is removed if a kept simulation is closer than this\n");
+  printf("  -f cost function: mae, rmse or sam (spectral angle in radians)\n");
+  printf("  -z normalize bands to z-scores with mean and standard deviation of the LUT\n");
+  printf("  -W comma-separated band weights, one per band\n");
+  printf("  use the same -f, -z and -W as for rtm-inversion\n");
+  printf("\n");
+
+  exit(exit_code);
+  return;
+}
+
+typedef struct {
+  char lut_path[STRLEN];
+  char simulation_path[STRLEN];
+  char thin_lut_path[STRLEN];
+  char thin_simulation_path[STRLEN];
+  float tolerance;
+  int metric;
+  bool zscore;
+  char weights[STRLEN];
+} args_t;
+
+
+void parse_args(int argc, char *argv[], args_t *args){
+int opt, received_n = 0, expected_n = 5;
+
+  opterr = 0;
+
+  args->tolerance = -1;
+  args->metric = COST_MAE;
+  args->zscore = false;
+  copy_string(args->weights, STRLEN, "NULL");
+
+  while ((opt = getopt(argc, argv, "l:s:L:S:e:f:zW:")) != -1){
+    switch(opt){
+      case 'l':
+        copy_string(args->lut_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 's':
+        copy_string(args->simulation_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 'L':
+        copy_string(args->thin_lut_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 'S':
+        copy_string(args->thin_simulation_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 'e':
+        args->tolerance = atof(optarg);
+        received_n++;
+        break;
+      case 'f':
+        if ((args->metric = cost_metric(optarg)) < 0) {
+          fprintf(stderr, "unknown cost function %s\n", optarg);
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'z':
+        args->zscore = true;
+        break;
+      case 'W':
+        copy_string(args->weights, STRLEN, optarg);
+        break;
+      case '?':
+        if (isprint(optopt)){
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        usage(argv[0], FAILURE);
+      default:
+        fprintf(stderr, "Error parsing arguments.\n");
+        usage(argv[0], FAILURE);
+    }
+  }
+
+  if (received_n != expected_n) {
+    fprintf(stderr, "missing arguments\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->tolerance < 0) {
+    fprintf(stderr, "-e needs to be >= 0\n");
+    usage(argv[0], FAILURE);
+  }
+
+  int n_input = argc-optind;
+
+  if (n_input > 0) {
+    fprintf(stderr, "too many parameters specified\n");
+    usage(argv[0], FAILURE);
+  }
+
+  return;
+}
+
+
+float *parse_weights(char *list, int nband, char *exe){
+char buffer[STRLEN];
+char *ptr = NULL, *saveptr = NULL;
+float *weight = NULL;
+int n = 0;
+
+
+  alloc((void**)&weight, nband, sizeof(float));
+
+  copy_string(buffer, STRLEN, list);
+
+  for (ptr = strtok_r(buffer, ",", &saveptr); ptr != NULL; ptr = strtok_r(NULL, ",", &saveptr)) {
+    if (n == nband || char_to_float(ptr, &weight[n]) == FAILURE || weight[n] < 0) {
+      fprintf(stderr, "-W needs %d non-negative weights (%s)\n", nband, list);
+      usage(exe, FAILURE);
+    }
+    n++;
+  }
+
+  if (n != nband) {
+    fprintf(stderr, "-W needs %d non-negative weights (%s)\n", nband, list);
+    usage(exe, FAILURE);
+  }
+
+  return weight;
+}
+
+
+// sum over the bands of a transformed spectrum
+typedef struct {
+  float key;
+  int row;
+} row_key_t;
+
+int cmp_key(const void *a, const void *b){
+float ka = ((const row_key_t*)a)->key;
+float kb = ((const row_key_t*)b)->key;
+
+  if (ka < kb) return -1;
+  if (ka > kb) return  1;
+  return 0;
+}
+
+
+// two spectra within the tolerance cannot differ by more than this in key
+float key_radius(int metric, float tolerance, int nband){
+
+  // |sum(d)| <= sum|d| = n*MAE, and |sum(d)| <= sqrt(n)*|d| = n*RMSE
+  if (metric != COST_SAM) return nband*tolerance;
+
+  // unit spectra, |d| is the chord of the angle
+  return sqrt(nband)*2*sin(tolerance/2);
+}
+
+
+int main ( int argc, char *argv[] ){
+
+
+args_t args;
+table_t parameters, simulations;
+search_t search;
+row_key_t *keys = NULL;
+int *kept = NULL;
+float *weight = NULL;
+int nkept = 0;
+double error_sum = 0, error_max = 0;
+
+
+  parse_args(argc, argv, &args);
+
+  parameters  = read_table(args.lut_path, false, false);
+  simulations = read_table(args.simulation_path, false, false);
+
+  if (parameters.nrow != simulations.nrow) {
+    fprintf(stderr, "LUT and simulations have different number of rows (%d vs %d)\n",
+      parameters.nrow, simulations.nrow);
+    usage(argv[0], FAILURE);
+  }
+
+  if (strcmp(args.weights, "NULL") != 0) {
+    weight = parse_weights(args.weights, simulations.ncol, argv[0]);
+  }
+
+  // spectra are compared as rtm-inversion compares them
+  search = prepare_search(&simulations, args.metric, args.zscore, weight);
+
+  int nrow  = search.nrow;
+  int nband = search.nband;
+  float radius = key_radius(args.metric, args.tolerance, nband);
+
+
+  alloc((void**)&keys, nrow, sizeof(row_key_t));
+  alloc((void**)&kept, nrow, sizeof(int));
+
+  for (int i = 0; i < nrow; i++) {
+    const float *s = search.spec + (size_t)i*nband;
+    keys[i].key = 0;
+    for (int b = 0; b < nband; b++) keys[i].key += s[b];
+    keys[i].row = i;
+  }
+
+  qsort(keys, nrow, sizeof(row_key_t), cmp_key);
+
+
+  // greedy: a row is kept unless an already kept row is within the tolerance.
+  // Rows are visited in ascending key, so only the most recently kept rows
+  // can be close enough.
+  for (int i = 0; i < nrow; i++) {
+
+    const float *x = search.spec + (size_t)keys[i].row*nband;
+    float min = FLT_MAX;
+
+    for (int j = nkept-1; j >= 0 && keys[i].key - keys[kept[j]].key <= radius; j--) {
+      float cost = search_cost(&search, x, keys[kept[j]].row);
+      if (cost < min) min = cost;
+    }
+
+    if (min <= args.tolerance) {
+      parameters.row_mask[keys[i].row]  = false;
+      simulations.row_mask[keys[i].row] = false;
+      error_sum += min;
+      if (min > error_max) error_max = min;
+    } else {
+      kept[nkept++] = i;
+    }
+
+  }
+
+  parameters.n_active_rows  = nkept;
+  simulations.n_active_rows = nkept;
+
+
+  // kept rows are written in their original order
+  write_table(&parameters,  args.thin_lut_path,        ",", true);
+  write_table(&simulations, args.thin_simulation_path, ",", true);
+
+  printf("cost function: %s%s%s\n", cost_name(args.metric),
+    args.zscore ? ", z-scores" : "", (weight != NULL) ? ", weighted" : "");
+  printf("tolerance: %g\n", args.tolerance);
+  printf("rows kept: %d of %d (%.1f%%)\n", nkept, nrow, 100.0*nkept/nrow);
+  printf("max. error of removed rows: %g\n", error_max);
+  printf("mean error of removed rows: %g\n", (nrow > nkept) ? error_sum/(nrow-nkept) : 0);
+
+
+  if (weight != NULL) free((void*)weight);
+  free((void*)keys);
+  free((void*)kept);
+  free_search(&search);
+  free_table(&parameters);
+  free_table(&simulations);
+
+  return SUCCESS;
+
+}
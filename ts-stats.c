@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <ctype.h>
+
+
+/** Geospatial Data Abstraction Library (GDAL) **/
+#include "gdal.h"       // public (C callable) GDAL entry points
+#include "cpl_conv.h"   // various convenience functions for CPL
+#include "cpl_string.h" // various convenience functions for strings
+
+
+#include "utils/const.h"
+#include "utils/alloc.h"
+#include "utils/dir.h"
+#include "utils/string.h"
+#include "utils/table.h"
+#include "utils/stats.h"
+
+#include <omp.h>
+
+
+// output bands
+enum { _COUNT_, _MEAN_, _SD_, _MIN_, _MAX_, _SKEW_, _KURT_, _SLOPE_, _INTERCEPT_, _RSQ_, _NOUT_ };
+const char *output_names[_NOUT_] = { "count", "mean", "standard deviation", "minimum", "maximum",
+  "skewness", "kurtosis", "slope", "intercept", "r-squared" };
+
+// nodata of the outputs
+#define NODATA -9999
+
+// number of pixels that are updated together by one thread
+#define SERIES_CELLS NPOW_12
+
+
+void usage(char *exe, int exit_code){
+
+  printf("\n");
+  printf("Usage: %s -o output.tif [-b 1] [-d times.csv] [-M 256] *files\n", exe);
+  printf("  \n");
+  printf("  *files are the dates of a time series, with the same dimensions\n");
+  printf("   the time of each file is taken in decimal years from a leading YYYYMMDD\n");
+  printf("   date in its name. The files are streamed block by block\n");
+  printf("  -o output with the number of valid observations, mean, standard deviation,\n");
+  printf("   minimum, maximum, skewness and kurtosis of each pixel, followed by the\n");
+  printf("   slope, intercept and R^2 of an OLS regression against time. The intercept\n");
+  printf("   is the value at the first time. Statistics that cannot be estimated are %d\n", NODATA);
+  printf("  -b band that is analysed (1-based), default: 1\n");
+  printf("   the nodata value of the band, and NaN, are missing observations\n");
+  printf("  -d times of the files, one value per line, in the order of the files\n");
+  printf("   the slope is then given per unit of these times\n");
+  printf("  -M memory budget (MB) for the block of the time series held in memory\n");
+  printf("\n");
+
+  exit(exit_code);
+  return;
+}
+
+typedef struct {
+  int n_input;
+  char **input_path;
+  char output_path[STRLEN];
+  char time_path[STRLEN];
+  int band;
+  float budget;
+} args_t;
+
+
+void parse_args(int argc, char *argv[], args_t *args){
+int opt, received_n = 0, expected_n = 1;
+
+  opterr = 0;
+
+  copy_string(args->time_path, STRLEN, "NULL");
+  args->band = 1;
+  args->budget = 256;
+
+  while ((opt = getopt(argc, argv, "o:b:d:M:")) != -1){
+    switch(opt){
+      case 'o':
+        copy_string(args->output_path, STRLEN, optarg);
+        received_n++;
+        break;
+      case 'b':
+        args->band = atoi(optarg);
+        break;
+      case 'd':
+        copy_string(args->time_path, STRLEN, optarg);
+        break;
+      case 'M':
+        args->budget = atof(optarg);
+        break;
+      case '?':
+        if (isprint(optopt)){
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        usage(argv[0], FAILURE);
+      default:
+        fprintf(stderr, "Error parsing arguments.\n");
+        usage(argv[0], FAILURE);
+    }
+  }
+
+  if (received_n != expected_n) {
+    fprintf(stderr, "missing arguments\n");
+    usage(argv[0], FAILURE);
+  }
+
+  if (args->band < 1 || args->budget <= 0) {
+    fprintf(stderr, "-b and -M need to be > 0\n");
+    usage(argv[0], FAILURE);
+  }
+
+
+  args->n_input = argc-optind;
+
+  if (args->n_input < 2) {
+    fprintf(stderr, "at least two input files are needed\n");
+    usage(argv[0], FAILURE);
+  }
+
+  alloc_2D((void***)&args->input_path, args->n_input, STRLEN, sizeof(char));
+
+  for (int i = 0; i < args->n_input; i++) {
+    copy_string(args->input_path[i], STRLEN, argv[optind + i]);
+    if (!fileexist(args->input_path[i])) {
+      fprintf(stderr, "file %s does not exist\n", args->input_path[i]);
+      usage(argv[0], FAILURE);
+    }
+  }
+
+  return;
+}
+
+
+// time from a leading YYYYMMDD date in the file name, in decimal years
+bool time_from_name(char *path, double *time){
+const int days_before[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+char bname[STRLEN];
+int year, month, day;
+
+
+  basename_with_ext(path, bname, STRLEN);
+
+  for (int i = 0; i < 8; i++) {
+    if (!isdigit((unsigned char)bname[i])) return false;
+  }
+
+  if (sscanf(bname, "%4d%2d%2d", &year, &month, &day) != 3 ||
+      month < 1 || month > 12 || day < 1 || day > 31) return false;
+
+  bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  int doy = days_before[month-1] + day + (leap && month > 2);
+
+  *time = year + (doy - 1.0) / (leap ? 366 : 365);
+
+  return true;
+}
+
+
+// time of each file, from -d or from the file names
+double *read_times(args_t *args, char *exe){
+double *time = NULL;
+
+
+  alloc((void**)&time, args->n_input, sizeof(double));
+
+  if (strcmp(args->time_path, "NULL") != 0) {
+
+    table_t times = read_table(args->time_path, false, false);
+
+    if (times.nrow != args->n_input || times.ncol != 1) {
+      fprintf(stderr, "%s needs one time per file (%d x %d, expected %d x 1)\n",
+        args->time_path, times.nrow, times.ncol, args->n_input);
+      usage(exe, FAILURE);
+    }
+
+    for (int i = 0; i < args->n_input; i++) time[i] = table_get(&times, i, 0);
+
+    free_table(&times);
+
+    return time;
+  }
+
+  for (int i = 0; i < args->n_input; i++) {
+    if (!time_from_name(args->input_path[i], &time[i])) {
+      fprintf(stderr, "%s does not start with a YYYYMMDD date, use -d\n", args->input_path[i]);
+      usage(exe, FAILURE);
+    }
+  }
+
+  return time;
+}
+
+
+// statistics of the pixels of one chunk, from the accumulated moments
+void finalize(series_t *series, int offset, int n, float **output){
+double slope, intercept, rsq;
+
+
+  for (int c = offset; c < offset+n; c++) {
+
+    double k = series->count[c];
+
+    for (int o = 0; o < _NOUT_; o++) output[o][c] = NODATA;
+    output[_COUNT_][c] = k;
+
+    if (k < 1) continue;
+
+    output[_MEAN_][c] = series->mean[c];
+    output[_MIN_][c]  = series->min[c];
+    output[_MAX_][c]  = series->max[c];
+
+    if (k > 1) output[_SD_][c] = standdev(series->m2[c], k);
+
+    if (series->m2[c] > 0) {
+      output[_SKEW_][c] = skewness(series->m2[c], series->m3[c], k);
+      output[_KURT_][c] = kurtosis(series->m2[c], series->m4[c], k);
+    }
+
+    // the regression needs at least two different times
+    if (series->m2_t[c] > 0) {
+      linreg_coefs(series->mean_t[c], series->mean[c], series->cov[c], series->m2_t[c], &slope, &intercept);
+      output[_SLOPE_][c]     = slope;
+      output[_INTERCEPT_][c] = intercept;
+      if (series->m2[c] > 0) {
+        linreg_rsquared(series->cov[c], series->m2_t[c], series->m2[c], &rsq);
+        output[_RSQ_][c] = rsq;
+      }
+    }
+
+  }
+
+  return;
+}
+
+
+int main ( int argc, char *argv[] ){
+
+
+args_t args;
+GDALDatasetH dataset = NULL, output_dataset = NULL;
+GDALRasterBandH output_band = NULL;
+GDALDriverH output_driver = NULL;
+char **output_options = NULL;
+char projection[STRLEN];
+double geotransformation[6];
+double *time = NULL, first;
+float *nodata = NULL;
+float **stack = NULL, **output = NULL;
+series_t series;
+int ncol = 0, nrow = 0, xblock, yblock, nblock, failed = 0;
+
+
+  parse_args(argc, argv, &args);
+
+  time = read_times(&args, argv[0]);
+
+  GDALAllRegister();
+
+  alloc((void**)&nodata, args.n_input, sizeof(float));
+
+
+  // all files are checked up front, the data is read per block
+  for (int i = 0; i < args.n_input; i++) {
+
+    if ((dataset = GDALOpen(args.input_path[i], GA_ReadOnly)) == NULL){
+      fprintf(stderr, "could not open %s\n", args.input_path[i]);
+      usage(argv[0], FAILURE);
+    }
+
+    if (i == 0) {
+      ncol = GDALGetRasterXSize(dataset);
+      nrow = GDALGetRasterYSize(dataset);
+      copy_string(projection, STRLEN, GDALGetProjectionRef(dataset));
+      GDALGetGeoTransform(dataset, geotransformation);
+    }
+
+    if (GDALGetRasterXSize(dataset) != ncol || GDALGetRasterYSize(dataset) != nrow) {
+      fprintf(stderr, "input files have different dimensions\n");
+      usage(argv[0], FAILURE);
+    }
+
+    if (GDALGetRasterCount(dataset) < args.band) {
+      fprintf(stderr, "%s has no band %d\n", args.input_path[i], args.band);
+      usage(argv[0], FAILURE);
+    }
+
+    int has_nodata = 0;
+    GDALRasterBandH band = GDALGetRasterBand(dataset, args.band);
+
+    nodata[i] = GDALGetRasterNoDataValue(band, &has_nodata);
+    if (!has_nodata) nodata[i] = NAN;
+
+    if (i == 0) GDALGetBlockSize(band, &xblock, &yblock);
+
+    GDALClose(dataset);
+
+  }
+
+
+  // times are counted from the first time
+  first = time[0];
+  for (int i = 1; i < args.n_input; i++) if (time[i] < first) first = time[i];
+  for (int i = 0; i < args.n_input; i++) time[i] -= first;
+
+
+  // blocks of full rows, aligned to the native blocks, that fit into -M
+  double row_bytes = (double)ncol*(args.n_input*sizeof(float) + _NOUT_*sizeof(float) + 10*sizeof(double));
+  int nline = args.budget*1048576.0 / row_bytes;
+
+  if (yblock < 1 || yblock > nrow) yblock = nrow;
+  if (nline > yblock) nline = nline / yblock * yblock;
+  if (nline > nrow) nline = nrow;
+  if (nline < 1) nline = 1;
+
+  nblock = (nrow + nline - 1) / nline;
+
+  alloc_2D((void***)&stack,  args.n_input, (size_t)nline*ncol, sizeof(float));
+  alloc_2D((void***)&output, _NOUT_,       (size_t)nline*ncol, sizeof(float));
+  series = allocate_series(nline*ncol);
+
+
+  if ((output_driver = GDALGetDriverByName("GTiff")) == NULL) {
+    printf("%s driver not found\n", "GTiff");
+    usage(argv[0], FAILURE);
+  }
+
+  output_options = CSLSetNameValue(output_options, "COMPRESS", "ZSTD");
+  output_options = CSLSetNameValue(output_options, "PREDICTOR", "3");
+  output_options = CSLSetNameValue(output_options, "BIGTIFF", "YES");
+
+  if ((output_dataset = GDALCreate(output_driver, args.output_path, ncol, nrow, _NOUT_, GDT_Float32, output_options)) == NULL) {
+    printf("Error creating file %s.\n", args.output_path);
+    usage(argv[0], FAILURE);
+  }
+
+  for (int o = 0; o < _NOUT_; o++) {
+    output_band = GDALGetRasterBand(output_dataset, o+1);
+    GDALSetDescription(output_band, output_names[o]);
+    GDALSetRasterNoDataValue(output_band, NODATA);
+  }
+
+  printf("files: %d\n", args.n_input);
+  printf("band: %d\n", args.band);
+  printf("dimensions: %d x %d = %d pixels\n", nrow, ncol, nrow*ncol);
+  printf("blocks: %d of %d x %d pixels\n", nblock, nline, ncol);
+  printf("threads: %d\n", omp_get_max_threads());
+  printf("\n");
+
+  double t0 = omp_get_wtime();
+
+
+  for (int y0 = 0; y0 < nrow; y0 += nline) {
+
+    int ny = (nrow - y0 < nline) ? nrow - y0 : nline;
+    int ncell = ny*ncol;
+
+    // each thread reads its files with its own dataset handles
+    #pragma omp parallel for schedule(dynamic) reduction(+: failed)
+    for (int i = 0; i < args.n_input; i++) {
+
+      GDALDatasetH thread_dataset = GDALOpen(args.input_path[i], GA_ReadOnly);
+
+      if (thread_dataset == NULL || GDALRasterIO(GDALGetRasterBand(thread_dataset, args.band), GF_Read,
+          0, y0, ncol, ny, stack[i], ncol, ny, GDT_Float32, 0, 0) == CE_Failure) failed++;
+
+      if (thread_dataset != NULL) GDALClose(thread_dataset);
+
+    }
+
+    if (failed > 0) {
+      printf("could not read %d of %d files at row %d\n", failed, args.n_input, y0);
+      usage(argv[0], FAILURE);
+    }
+
+    // all dates are added to a chunk of pixels, while it is in cache
+    #pragma omp parallel for schedule(static)
+    for (int c0 = 0; c0 < ncell; c0 += SERIES_CELLS) {
+
+      int n = (ncell - c0 < SERIES_CELLS) ? ncell - c0 : SERIES_CELLS;
+
+      for (int i = 0; i < args.n_input; i++) {
+        update_series(&series, c0, n, stack[i] + c0, time[i], nodata[i]);
+      }
+
+      finalize(&series, c0, n, output);
+
+    }
+
+    for (int o = 0; o < _NOUT_; o++) {
+      output_band = GDALGetRasterBand(output_dataset, o+1);
+      if (GDALRasterIO(output_band, GF_Write, 0, y0, ncol, ny,
+          output[o], ncol, ny, GDT_Float32, 0, 0) == CE_Failure){
+        printf("Unable to write band %d in %s.\n", o+1, args.output_path);
+        usage(argv[0], FAILURE);
+      }
+    }
+
+    reset_series(&series);
+
+  }
+
+  printf("processing time: %.3f s\n", omp_get_wtime() - t0);
+  printf("\n");
+
+
+  GDALSetGeoTransform(output_dataset, geotransformation);
+  GDALSetProjection(output_dataset,   projection);
+
+  GDALClose(output_dataset);
+
+  if (output_options != NULL) CSLDestroy(output_options);
+
+  free_series(&series);
+  free_2D((void**)stack,  args.n_input);
+  free_2D((void**)output, _NOUT_);
+  free_2D((void**)args.input_path, args.n_input);
+  free((void*)nodata);
+  free((void*)time);
+
+  return SUCCESS;
+
+}
+
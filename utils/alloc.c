@@ -24,6 +24,27 @@ void *arr = NULL;
 }
 
 
+/** Allocate aligned array
++++ This function allocates a block of memory that starts at a multiple of
++++ ALLOC_ALIGN bytes, and initializes it with 0. Free it with free().
+--- ptr:    Pointer to the memory block
+--- n:      Number of elements to allocate
+--- size:   Size of each element
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void alloc_aligned(void **ptr, size_t n, size_t size){
+void *arr = NULL;
+size_t bytes = (n*size + ALLOC_ALIGN - 1) / ALLOC_ALIGN * ALLOC_ALIGN;
+
+  if (bytes == 0) bytes = ALLOC_ALIGN;
+  if (posix_memalign(&arr, ALLOC_ALIGN, bytes) != 0){ printf("unable to allocate memory!\n"); exit(1);}
+  memset(arr, 0, bytes);
+
+  *ptr = arr;
+  return;
+}
+
+
 /** Allocate 2D-array
 +++ This function allocates blocks of memory, and initializes them with 0.
 --- ptr:    Pointer to the memory block
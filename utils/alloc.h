@@ -15,7 +15,11 @@ Allocation header
 extern "C" {
 #endif
 
+// alignment of aligned allocations in bytes (cache line)
+#define ALLOC_ALIGN 64
+
 void alloc(void **ptr, size_t n, size_t size);
+void alloc_aligned(void **ptr, size_t n, size_t size);
 void alloc_2D(void ***ptr, size_t n1, size_t n2, size_t size);
 void alloc_3D(void ****ptr, size_t n1, size_t n2, size_t n3, size_t size);
 void alloc_2DC(void ***ptr, size_t n1, size_t n2, size_t size);
@@ -0,0 +1,162 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for caching search results of pixel spectra.
+The cache is an open-addressing hash table keyed on the raw Int16 band
+vector. When all probed slots are taken, the home slot is overwritten.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "cache.h"
+
+
+/** Hash a pixel spectrum
++++ FNV-1a over the band values, followed by a 64bit finalizer to spread
++++ the low bits that are used for slot selection.
+--- key:    pixel spectrum
+--- nband:  number of bands
++++ Return: hash value
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static uint64_t cache_hash(const short *key, int nband){
+uint64_t h = 14695981039346656037ULL;
+int b;
+
+  for (b=0; b<nband; b++){
+    h ^= (uint16_t)key[b];
+    h *= 1099511628211ULL;
+  }
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+
+/** Allocate cache
+--- nslot:  number of slots, rounded up to the next power of two
+--- nband:  number of bands
+--- k:      number of LUT rows per slot
++++ Return: cache
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+cache_t allocate_cache(int nslot, int nband, int k){
+cache_t cache;
+int i;
+
+
+  cache.nband = nband;
+  cache.k = k;
+  cache.nslot = 1;
+  while (cache.nslot < nslot) cache.nslot *= 2;
+
+  alloc((void**)&cache.key,  (size_t)cache.nslot*nband, sizeof(short));
+  alloc((void**)&cache.row,  (size_t)cache.nslot*k, sizeof(int));
+  alloc((void**)&cache.cost, (size_t)cache.nslot*k, sizeof(float));
+
+  for (i=0; i<cache.nslot; i++) cache.row[(size_t)i*k] = CACHE_EMPTY;
+
+  cache.lookups = 0;
+  cache.hits = 0;
+
+  return cache;
+}
+
+
+/** Look up a pixel spectrum
++++ If the spectrum is found, its slot is returned. Otherwise, the slot
++++ where the spectrum should be inserted is returned.
+--- cache:  cache
+--- key:    pixel spectrum
+--- slot:   slot (returned)
++++ Return: true if found, false if not
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool cache_lookup(cache_t *cache, const short *key, int *slot){
+uint64_t h = cache_hash(key, cache->nband);
+int mask = cache->nslot - 1;
+int home = (int)(h & mask);
+int i, s;
+
+
+  cache->lookups++;
+
+  for (i=0; i<CACHE_PROBE && i<cache->nslot; i++){
+
+    s = (home + i) & mask;
+
+    if (cache->row[(size_t)s*cache->k] == CACHE_EMPTY){
+      *slot = s;
+      return false;
+    }
+
+    if (memcmp(cache->key + (size_t)s*cache->nband, key, cache->nband*sizeof(short)) == 0){
+      *slot = s;
+      cache->hits++;
+      return true;
+    }
+
+  }
+
+  // evict
+  *slot = home;
+
+  return false;
+}
+
+
+/** Insert a pixel spectrum
++++ Only the first LUT row of the slot is set, the others can be set with
++++ cache_store.
+--- cache:  cache
+--- slot:   slot, as returned by cache_lookup
+--- key:    pixel spectrum
+--- row:    best LUT row
+--- cost:   cost of best LUT row
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void cache_insert(cache_t *cache, int slot, const short *key, int row, float cost){
+
+  memcpy(cache->key + (size_t)slot*cache->nband, key, cache->nband*sizeof(short));
+  cache->row[(size_t)slot*cache->k]  = row;
+  cache->cost[(size_t)slot*cache->k] = cost;
+
+  return;
+}
+
+
+/** Store the k best LUT rows of a slot
+--- cache:  cache
+--- slot:   slot
+--- row:    best LUT rows, k
+--- cost:   cost of best LUT rows, k
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void cache_store(cache_t *cache, int slot, const int *row, const float *cost){
+
+  memcpy(cache->row  + (size_t)slot*cache->k, row,  cache->k*sizeof(int));
+  memcpy(cache->cost + (size_t)slot*cache->k, cost, cache->k*sizeof(float));
+
+  return;
+}
+
+
+/** Memory footprint of cache
+--- cache:  cache
++++ Return: bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t cache_memory(cache_t *cache){
+
+  return (size_t)cache->nslot*(cache->nband*sizeof(short) + cache->k*(sizeof(int) + sizeof(float)));
+}
+
+
+/** Free cache
+--- cache:  cache
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_cache(cache_t *cache){
+
+  if (cache->key  != NULL){ free((void*)cache->key);  cache->key  = NULL; }
+  if (cache->row  != NULL){ free((void*)cache->row);  cache->row  = NULL; }
+  if (cache->cost != NULL){ free((void*)cache->cost); cache->cost = NULL; }
+
+  return;
+}
@@ -0,0 +1,53 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Spectral cache header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "const.h"
+#include "alloc.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// row value of a slot that holds no spectrum
+#define CACHE_EMPTY -1
+
+// number of slots that are probed before an entry is evicted
+#define CACHE_PROBE 8
+
+typedef struct {
+  int nband;     // number of bands
+  int nslot;     // number of slots, power of two
+  int k;         // number of LUT rows per slot
+  short *key;    // pixel spectra, nslot x nband
+  int *row;      // best LUT rows, nslot x k, the first row of a slot is 
+                 // CACHE_EMPTY, or user-defined tags < -1
+  float *cost;   // cost of best LUT rows, nslot x k
+  long lookups;  // number of lookups
+  long hits;     // number of lookups that found the spectrum
+} cache_t;
+
+cache_t allocate_cache(int nslot, int nband, int k);
+bool cache_lookup(cache_t *cache, const short *key, int *slot);
+void cache_insert(cache_t *cache, int slot, const short *key, int row, float cost);
+void cache_store(cache_t *cache, int slot, const int *row, const float *cost);
+size_t cache_memory(cache_t *cache);
+void free_cache(cache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,97 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for converting between the summed band
+terms of the search kernels and the cost functions. MAE sums absolute
+differences, RMSE squared differences. The spectral angle (SAM) is com-
+puted from unit-length spectra, where the squared Euclidean distance is
+the squared chord 2*sin(angle/2). Thus, all cost functions can be pruned
+on partial sums.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "cost.h"
+
+
+/** Cost function from name
+--- name:   mae, rmse or sam
++++ Return: cost function, or -1 if unknown
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int cost_metric(const char *name){
+
+  if (strcmp(name, "mae")  == 0) return COST_MAE;
+  if (strcmp(name, "rmse") == 0) return COST_RMSE;
+  if (strcmp(name, "sam")  == 0) return COST_SAM;
+
+  return -1;
+}
+
+
+/** Name of cost function
+--- metric: cost function
++++ Return: name
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+const char *cost_name(int metric){
+
+  switch (metric){
+    case COST_MAE:  return "MAE";
+    case COST_RMSE: return "RMSE";
+    case COST_SAM:  return "SAM";
+  }
+
+  return "unknown";
+}
+
+
+/** Does the cost function sum squared terms?
+--- metric: cost function
++++ Return: 1 if squared, 0 if absolute
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int cost_squared(int metric){
+
+  return metric != COST_MAE;
+}
+
+
+/** Cost from summed band terms
+--- metric: cost function
+--- sum:    summed band terms
+--- nband:  number of bands
++++ Return: cost (SAM in radians)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float cost_from_sum(int metric, float sum, int nband){
+float chord;
+
+  switch (metric){
+    case COST_RMSE: 
+      return sqrtf(sum/nband);
+    case COST_SAM:
+      chord = sqrtf(sum)/2;
+      if (chord > 1) chord = 1;
+      return 2*asinf(chord);
+  }
+
+  return sum/nband;
+}
+
+
+/** Summed band terms from cost
++++ This is the inverse of cost_from_sum, and converts cost bounds for 
++++ pruning.
+--- metric: cost function
+--- cost:   cost (SAM in radians)
+--- nband:  number of bands
++++ Return: summed band terms
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float cost_to_sum(int metric, float cost, int nband){
+float chord;
+
+  switch (metric){
+    case COST_RMSE: 
+      return cost*cost*nband;
+    case COST_SAM:
+      chord = 2*sinf(cost/2);
+      return chord*chord;
+  }
+
+  return cost*nband;
+}
+
@@ -0,0 +1,42 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Cost function header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef COST_H
+#define COST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// cost functions
+enum { COST_MAE, COST_RMSE, COST_SAM };
+
+/** Cost term of one band
++++ This is inlined into the search kernels. With squared = 0, the term
++++ sums to MAE, with squared = 1 to RMSE and SAM. The kernels are called
++++ with a constant, such that each is compiled once per variant.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline float cost_term(float d, const int squared){
+  return squared ? d*d : fabsf(d);
+}
+
+int cost_metric(const char *name);
+const char *cost_name(int metric);
+int cost_squared(int metric);
+float cost_from_sum(int metric, float sum, int nband);
+float cost_to_sum(int metric, float cost, int nband);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -257,3 +257,23 @@ char *slash;
   return;
 }
 
+
+/** This function resolves the absolute path of an existing file. The 
++++ path is copied as is if it cannot be resolved.
+--- path:     file path
+--- absolute: buffer that will hold the absolute path
+--- size:     length of the buffer
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void absolutepath(char* path, char absolute[], int size){
+char resolved[PATH_MAX];
+
+  if (realpath(path, resolved) != NULL){
+    copy_string(absolute, size, resolved);
+  } else {
+    copy_string(absolute, size, path);
+  }
+
+  return;
+}
+
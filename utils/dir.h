@@ -15,6 +15,7 @@ Directory/file support header
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "const.h"
 #include "string.h"
@@ -42,6 +43,7 @@ void extension2(char* path, char extension[], int size);
 void basename_without_ext(char* path, char basename[], int size);
 void basename_with_ext(char* path, char basename[], int size);
 void directoryname(char* path, char dirname[], int size);
+void absolutepath(char* path, char absolute[], int size);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,98 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for keeping the k best LUT rows of a pixel
+in a bounded max-heap. The root holds the worst of the k rows, such that
+it can directly be used as a bound during the search.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "heap.h"
+
+
+/** Restore heap order below a node
+--- cost:   heap costs
+--- row:    heap rows
+--- n:      number of heap entries
+--- i:      node
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void heap_down(float *cost, int *row, int n, int i){
+float c = cost[i];
+int r = row[i];
+int j;
+
+  while ((j = 2*i+1) < n){
+    if (j+1 < n && cost[j+1] > cost[j]) j++;
+    if (cost[j] <= c) break;
+    cost[i] = cost[j];
+    row[i]  = row[j];
+    i = j;
+  }
+
+  cost[i] = c;
+  row[i]  = r;
+
+  return;
+}
+
+
+/** Push a LUT row into a bounded heap
++++ While the heap holds less than k rows, the row is added. Otherwise,
++++ it replaces the root if it is better.
+--- cost:   heap costs, k
+--- row:    heap rows, k
+--- n:      number of heap entries (updated)
+--- k:      heap capacity
+--- c:      cost of new row
+--- r:      new row
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void heap_push(float *cost, int *row, int *n, int k, float c, int r){
+int i, j;
+
+
+  if (*n < k){
+
+    // sift up
+    i = (*n)++;
+    while (i > 0 && cost[j = (i-1)/2] < c){
+      cost[i] = cost[j];
+      row[i]  = row[j];
+      i = j;
+    }
+    cost[i] = c;
+    row[i]  = r;
+
+  } else if (c < cost[0]){
+
+    cost[0] = c;
+    row[0]  = r;
+    heap_down(cost, row, *n, 0);
+
+  }
+
+  return;
+}
+
+
+/** Sort heap
++++ This function sorts the heap in place by ascending cost. The result
++++ is not a heap anymore.
+--- cost:   heap costs
+--- row:    heap rows
+--- n:      number of heap entries
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void heap_sort(float *cost, int *row, int n){
+float c;
+int r, i;
+
+
+  for (i=n-1; i>0; i--){
+    c = cost[0]; cost[0] = cost[i]; cost[i] = c;
+    r = row[0];  row[0]  = row[i];  row[i]  = r;
+    heap_down(cost, row, i, 0);
+  }
+
+  return;
+}
+
@@ -0,0 +1,25 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Bounded max-heap header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void heap_push(float *cost, int *row, int *n, int k, float c, int r);
+void heap_sort(float *cost, int *row, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,336 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for building and searching an inverted-file
+(IVF) index. The indexed vectors are clustered with k-means, and each
+vector is stored in the list of its closest cluster center. A query only
+scans the lists of the nprobe closest centers. nprobe = nlist is exact.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "ivf.h"
+
+
+/** Summed band terms between two vectors
+--- x:      vector 1
+--- y:      vector 2
+--- n:      length of vectors
+--- sq:     squared (1) or absolute (0) differences
++++ Return: summed band terms
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static float ivf_sum(const float *x, const float *y, int n, int sq){
+float sum = 0;
+int b;
+
+  for (b=0; b<n; b++) sum += cost_term(x[b] - y[b], sq);
+
+  return sum;
+}
+
+
+/** Closest cluster center
+--- ivf:    IVF index
+--- x:      query vector
++++ Return: index of closest center
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static int ivf_closest(ivf_t *ivf, const float *x){
+float cost, min_cost = FLT_MAX;
+int l, l_min = 0;
+
+  for (l=0; l<ivf->nlist; l++){
+    cost = ivf_sum(x, ivf->centroids + (size_t)l*ivf->nband, ivf->nband, cost_squared(ivf->metric));
+    if (cost < min_cost){ min_cost = cost; l_min = l; }
+  }
+
+  return l_min;
+}
+
+
+/** Build IVF index
++++ This function clusters the vectors with k-means (Lloyd's algorithm).
++++ The centers are trained on a subsample of at most 256 vectors per
++++ list, then all vectors are assigned to their closest center. The
++++ vectors are copied into list order, such that each list can be
++++ scanned contiguously.
+--- data:   vectors, nrow x nband, row-major
+--- nrow:   number of vectors
+--- nband:  dimension of vectors
+--- nlist:  number of clusters
+--- niter:  number of k-means iterations
+--- metric: cost function
++++ Return: IVF index
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+ivf_t build_ivf(const float *data, int nrow, int nband, int nlist, int niter, int metric){
+ivf_t ivf;
+int *sample = NULL, nsample;
+int *assign = NULL, *count = NULL, *fill = NULL;
+double *sum = NULL;
+unsigned int seed = 42;
+int i, j, l, b, it, tmp;
+
+
+  if (nlist > nrow) nlist = nrow;
+  if (nlist < 1) nlist = 1;
+
+  ivf.nlist = nlist;
+  ivf.nrow  = nrow;
+  ivf.nband = nband;
+  ivf.metric = metric;
+
+  alloc((void**)&ivf.centroids, (size_t)nlist*nband, sizeof(float));
+  alloc((void**)&ivf.offset,    nlist+1, sizeof(int));
+  alloc((void**)&ivf.rows,      nrow,    sizeof(int));
+  alloc((void**)&ivf.data,      (size_t)nrow*nband, sizeof(float));
+
+
+  // random training sample, first nlist entries seed the centers
+  nsample = (nrow < nlist*NPOW_08) ? nrow : nlist*NPOW_08;
+  alloc((void**)&sample, nrow, sizeof(int));
+  for (i=0; i<nrow; i++) sample[i] = i;
+  for (i=0; i<nsample; i++){
+    j = i + rand_r(&seed) % (nrow-i);
+    tmp = sample[i]; sample[i] = sample[j]; sample[j] = tmp;
+  }
+
+  for (l=0; l<nlist; l++){
+    memcpy(ivf.centroids + (size_t)l*nband, data + (size_t)sample[l]*nband, nband*sizeof(float));
+  }
+
+
+  alloc((void**)&assign, nrow,  sizeof(int));
+  alloc((void**)&count,  nlist, sizeof(int));
+  alloc((void**)&sum,    (size_t)nlist*nband, sizeof(double));
+
+  for (it=0; it<niter; it++){
+
+    #pragma omp parallel for schedule(static)
+    for (i=0; i<nsample; i++) assign[i] = ivf_closest(&ivf, data + (size_t)sample[i]*nband);
+
+    memset(count, 0, nlist*sizeof(int));
+    memset(sum,   0, (size_t)nlist*nband*sizeof(double));
+
+    for (i=0; i<nsample; i++){
+      count[assign[i]]++;
+      for (b=0; b<nband; b++) sum[(size_t)assign[i]*nband+b] += data[(size_t)sample[i]*nband+b];
+    }
+
+    for (l=0; l<nlist; l++){
+      if (count[l] > 0){
+        for (b=0; b<nband; b++) ivf.centroids[(size_t)l*nband+b] = sum[(size_t)l*nband+b]/count[l];
+      } else {
+        // re-seed empty clusters with a random training vector
+        i = rand_r(&seed) % nsample;
+        memcpy(ivf.centroids + (size_t)l*nband, data + (size_t)sample[i]*nband, nband*sizeof(float));
+      }
+    }
+
+  }
+
+
+  // assign all vectors, and sort them into lists
+  #pragma omp parallel for schedule(static)
+  for (i=0; i<nrow; i++) assign[i] = ivf_closest(&ivf, data + (size_t)i*nband);
+
+  memset(count, 0, nlist*sizeof(int));
+  for (i=0; i<nrow; i++) count[assign[i]]++;
+
+  ivf.offset[0] = 0;
+  for (l=0; l<nlist; l++) ivf.offset[l+1] = ivf.offset[l] + count[l];
+
+  alloc((void**)&fill, nlist, sizeof(int));
+  for (i=0; i<nrow; i++){
+    j = ivf.offset[assign[i]] + fill[assign[i]]++;
+    ivf.rows[j] = i;
+    memcpy(ivf.data + (size_t)j*nband, data + (size_t)i*nband, nband*sizeof(float));
+  }
+
+
+  free((void*)sample);
+  free((void*)assign);
+  free((void*)count);
+  free((void*)fill);
+  free((void*)sum);
+
+  return ivf;
+}
+
+
+/** Search IVF index
++++ This function finds the vector with the lowest cost in the lists of
++++ the nprobe closest cluster centers. The search can be warm-started
++++ with a known row and its cost. Vectors are abandoned as soon as their
++++ partial cost exceeds the best cost found so far.
+--- ivf:    IVF index
+--- x:      query vector
+--- nprobe: number of lists to scan
+--- best:   warm-start row, or -1
+--- cost:   cost of warm-start row, or FLT_MAX (in),
+            cost of best vector (out)
+--- sq:     squared (1) or absolute (0) differences
++++ Return: original row of best vector, or -1 if none was found
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline int search_ivf_(ivf_t *ivf, const float *x, int nprobe, int best, float *cost, const int sq){
+const float *y = NULL;
+float c, sum, min_sum;
+int i, l, p, b, i_min = -1;
+
+
+  if (nprobe > ivf->nlist) nprobe = ivf->nlist;
+  if (nprobe < 1) nprobe = 1;
+
+  float probe_cost[nprobe];
+  int   probe_list[nprobe];
+  int   nprobed = 0;
+
+  // keep the nprobe closest centers, sorted by distance
+  for (l=0; l<ivf->nlist; l++){
+
+    c = ivf_sum(x, ivf->centroids + (size_t)l*ivf->nband, ivf->nband, sq);
+
+    if (nprobed == nprobe && c >= probe_cost[nprobe-1]) continue;
+    if (nprobed < nprobe) nprobed++;
+
+    for (p=nprobed-1; p>0 && probe_cost[p-1] > c; p--){
+      probe_cost[p] = probe_cost[p-1];
+      probe_list[p] = probe_list[p-1];
+    }
+    probe_cost[p] = c;
+    probe_list[p] = l;
+
+  }
+
+  min_sum = (*cost < FLT_MAX) ? cost_to_sum(ivf->metric, *cost, ivf->nband) : FLT_MAX;
+
+  // scan lists
+  for (p=0; p<nprobed; p++){
+    l = probe_list[p];
+    for (i=ivf->offset[l]; i<ivf->offset[l+1]; i++){
+      y = ivf->data + (size_t)i*ivf->nband;
+      sum = 0;
+      for (b=0; b<ivf->nband; b++){
+        sum += cost_term(x[b] - y[b], sq);
+        if ((b & 1) && sum >= min_sum) break;
+      }
+      if (sum < min_sum){ min_sum = sum; i_min = i; }
+    }
+  }
+
+  if (i_min < 0) return best;
+
+  *cost = cost_from_sum(ivf->metric, min_sum, ivf->nband);
+
+  return ivf->rows[i_min];
+}
+
+
+// specialized kernels for absolute and squared differences
+int search_ivf(ivf_t *ivf, const float *x, int nprobe, int best, float *cost){
+
+  if (cost_squared(ivf->metric)) return search_ivf_(ivf, x, nprobe, best, cost, 1);
+  return search_ivf_(ivf, x, nprobe, best, cost, 0);
+}
+
+
+/** k-best search of IVF index
++++ Same as search_ivf, but the k best vectors are kept in a bounded max-
++++ heap, whose root is the bound for abandoning vectors.
+--- ivf:    IVF index
+--- x:      query vector
+--- nprobe: number of lists to scan
+--- k:      number of vectors to keep
+--- row:    original rows of best vectors, sorted by ascending cost 
+            (returned)
+--- cost:   cost of best vectors (returned)
+--- sq:     squared (1) or absolute (0) differences
++++ Return: number of vectors found
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline int search_ivf_k_(ivf_t *ivf, const float *x, int nprobe, int k, int *row, float *cost, const int sq){
+const float *y = NULL;
+float c, sum, max_sum = FLT_MAX;
+int i, l, p, b, n = 0;
+
+
+  if (nprobe > ivf->nlist) nprobe = ivf->nlist;
+  if (nprobe < 1) nprobe = 1;
+
+  float probe_cost[nprobe];
+  int   probe_list[nprobe];
+  int   nprobed = 0;
+
+  // keep the nprobe closest centers, sorted by distance
+  for (l=0; l<ivf->nlist; l++){
+
+    c = ivf_sum(x, ivf->centroids + (size_t)l*ivf->nband, ivf->nband, sq);
+
+    if (nprobed == nprobe && c >= probe_cost[nprobe-1]) continue;
+    if (nprobed < nprobe) nprobed++;
+
+    for (p=nprobed-1; p>0 && probe_cost[p-1] > c; p--){
+      probe_cost[p] = probe_cost[p-1];
+      probe_list[p] = probe_list[p-1];
+    }
+    probe_cost[p] = c;
+    probe_list[p] = l;
+
+  }
+
+  // scan lists
+  for (p=0; p<nprobed; p++){
+    l = probe_list[p];
+    for (i=ivf->offset[l]; i<ivf->offset[l+1]; i++){
+      y = ivf->data + (size_t)i*ivf->nband;
+      sum = 0;
+      for (b=0; b<ivf->nband; b++){
+        sum += cost_term(x[b] - y[b], sq);
+        if ((b & 1) && sum >= max_sum) break;
+      }
+      if (sum < max_sum){
+        heap_push(cost, row, &n, k, sum, i);
+        if (n == k) max_sum = cost[0];
+      }
+    }
+  }
+
+  heap_sort(cost, row, n);
+  for (i=0; i<n; i++){
+    cost[i] = cost_from_sum(ivf->metric, cost[i], ivf->nband);
+    row[i] = ivf->rows[row[i]];
+  }
+
+  return n;
+}
+
+
+// specialized kernels for absolute and squared differences
+int search_ivf_k(ivf_t *ivf, const float *x, int nprobe, int k, int *row, float *cost){
+
+  if (cost_squared(ivf->metric)) return search_ivf_k_(ivf, x, nprobe, k, row, cost, 1);
+  return search_ivf_k_(ivf, x, nprobe, k, row, cost, 0);
+}
+
+
+/** Memory footprint of IVF index
+--- ivf:    IVF index
++++ Return: bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t ivf_memory(ivf_t *ivf){
+
+  return (size_t)ivf->nlist*ivf->nband*sizeof(float) +
+         (size_t)(ivf->nlist+1)*sizeof(int) +
+         (size_t)ivf->nrow*sizeof(int) +
+         (size_t)ivf->nrow*ivf->nband*sizeof(float);
+}
+
+
+/** Free IVF index
+--- ivf:    IVF index
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_ivf(ivf_t *ivf){
+
+  if (ivf->centroids != NULL){ free((void*)ivf->centroids); ivf->centroids = NULL; }
+  if (ivf->offset    != NULL){ free((void*)ivf->offset);    ivf->offset    = NULL; }
+  if (ivf->rows      != NULL){ free((void*)ivf->rows);      ivf->rows      = NULL; }
+  if (ivf->data      != NULL){ free((void*)ivf->data);      ivf->data      = NULL; }
+
+  return;
+}
+
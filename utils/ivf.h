@@ -0,0 +1,47 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Inverted-file (IVF) index header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef IVF_H
+#define IVF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "const.h"
+#include "alloc.h"
+#include "heap.h"
+#include "cost.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  int nlist;        // number of clusters (inverted lists)
+  int nrow;         // number of indexed vectors
+  int nband;        // dimension of indexed vectors
+  int metric;       // cost function
+  float *centroids; // cluster centers, nlist x nband
+  int *offset;      // start of each list, nlist+1
+  int *rows;        // original row of each list entry, nrow
+  float *data;      // indexed vectors, grouped by list, nrow x nband
+} ivf_t;
+
+ivf_t build_ivf(const float *data, int nrow, int nband, int nlist, int niter, int metric);
+int search_ivf(ivf_t *ivf, const float *x, int nprobe, int best, float *cost);
+int search_ivf_k(ivf_t *ivf, const float *x, int nprobe, int k, int *row, float *cost);
+size_t ivf_memory(ivf_t *ivf);
+void free_ivf(ivf_t *ivf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
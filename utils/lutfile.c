@@ -0,0 +1,414 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for writing and mapping compiled LUTs. A
+compiled LUT holds the parameters and simulations as float32 columns,
+the column statistics, and optionally the stratified sampling order.
+It can also hold the row-major search spectra, transformed for one cost
+function, normalization and weighting, and their prefilter. All sections
+and columns are aligned to 64 bytes, and are stored in the byte order 
+of the machine that compiled the LUT. The file is mapped read-only, so 
+that processes on one node share the page cache. The columns are used 
+as tables, and the search spectra by the kernels, without copying.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "lutfile.h"
+
+
+/** Offset of the next aligned section
+--- offset: end of the previous section
++++ Return: aligned offset
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static int64_t lutfile_align(int64_t offset){
+
+  return (offset + LUTFILE_ALIGN - 1) / LUTFILE_ALIGN * LUTFILE_ALIGN;
+}
+
+
+/** Write zeros up to an aligned section
+--- fp:     file
+--- offset: aligned offset
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void lutfile_pad(FILE *fp, int64_t offset){
+char zero[LUTFILE_ALIGN];
+
+  memset(zero, 0, LUTFILE_ALIGN);
+  if (offset > ftell(fp)) fwrite(zero, 1, offset - ftell(fp), fp);
+
+  return;
+}
+
+
+/** Offsets of the sorted rows and spectra of the prefilter section
+--- header:      file header
+--- sorted:      offset of sorted rows (returned)
+--- sorted_spec: offset of sorted spectra (returned)
++++ Return:      end of the prefilter section
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static int64_t lutfile_prefilter(lutfile_header_t *header, int64_t *sorted, int64_t *sorted_spec){
+
+  *sorted      = lutfile_align(header->prefilter + header->nrow*(int64_t)sizeof(float));
+  *sorted_spec = lutfile_align(*sorted + header->nrow*(int64_t)sizeof(int32_t));
+
+  return *sorted_spec + header->nrow*header->nband*(int64_t)sizeof(float);
+}
+
+
+/** Write table columns as float32, each padded to the stride
+--- fp:     file
+--- table:  table
+--- stride: distance between columns in bytes
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void lutfile_columns(FILE *fp, table_t *table, int64_t stride){
+float **columns = table_columns(table);
+int64_t start = ftell(fp);
+int col;
+
+  for (col=0; col<table->ncol; col++){
+    lutfile_pad(fp, start + col*stride);
+    fwrite(columns[col], sizeof(float), table->nrow, fp);
+  }
+
+  return;
+}
+
+
+/** Write column statistics
+--- fp:     file
+--- table:  table
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void lutfile_stats(FILE *fp, table_t *table){
+double stats[LUTFILE_NSTAT];
+int col;
+
+  for (col=0; col<table->ncol; col++){
+    stats[0] = table->mean[col];
+    stats[1] = table->sd[col];
+    stats[2] = table->min[col];
+    stats[3] = table->max[col];
+    stats[4] = table->sum[col];
+    fwrite(stats, sizeof(double), LUTFILE_NSTAT, fp);
+  }
+
+  return;
+}
+
+
+/** Test whether a file is a compiled LUT
+--- fname:  file
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool is_lutfile(char *fname){
+FILE *fp = NULL;
+char magic[8];
+bool is = false;
+
+  if ((fp = fopen(fname, "rb")) == NULL) return false;
+
+  if (fread(magic, 1, 8, fp) == 8) is = memcmp(magic, LUTFILE_MAGIC, 8) == 0;
+
+  fclose(fp);
+
+  return is;
+}
+
+
+/** Write a compiled LUT
++++ The sampling order, the search spectra and the prefilter are taken 
++++ from the search LUT, if present. The search LUT needs to hold all 
++++ bands of the simulations.
+--- fname:       file
+--- parameters:  LUT parameters
+--- simulations: LUT simulations, same number of rows
+--- search:      search LUT of the simulations, or NULL
++++ Return:      void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void write_lutfile(char *fname, table_t *parameters, table_t *simulations, const search_t *search){
+lutfile_header_t header;
+FILE *fp = NULL;
+int64_t nrow = parameters->nrow;
+int64_t sorted = 0, sorted_spec = 0;
+const int *order = (search != NULL) ? search->order : NULL;
+bool spectra = search != NULL && search->spec != NULL;
+int row;
+
+
+  memset(&header, 0, sizeof(lutfile_header_t));
+  memcpy(header.magic, LUTFILE_MAGIC, 8);
+  header.version = LUTFILE_VERSION;
+  header.endian  = LUTFILE_ENDIAN;
+  header.npar    = parameters->ncol;
+  header.nband   = simulations->ncol;
+  header.nrow    = nrow;
+
+  header.stride      = lutfile_align(nrow*sizeof(float));
+  header.parameters  = lutfile_align(sizeof(lutfile_header_t));
+  header.simulations = lutfile_align(header.parameters  + header.npar*header.stride);
+  header.stats       = lutfile_align(header.simulations + header.nband*header.stride);
+  header.size        = header.stats + (int64_t)(header.npar+header.nband)*LUTFILE_NSTAT*sizeof(double);
+
+  if (order != NULL){
+    header.flags |= LUTFILE_ORDER;
+    header.order  = lutfile_align(header.size);
+    header.size   = header.order + nrow*sizeof(int32_t);
+  }
+
+  if (spectra){
+    header.flags    |= LUTFILE_SPECTRA;
+    header.metric    = search->metric;
+    header.transform = lutfile_align(header.size);
+    header.spectra   = lutfile_align(header.transform + 2*header.nband*sizeof(float));
+    header.size      = header.spectra + nrow*header.nband*sizeof(float);
+  }
+
+  if (spectra && search->index != NULL){
+    header.flags    |= LUTFILE_PREFILTER;
+    header.band1     = search->band1;
+    header.band2     = search->band2;
+    header.prefilter = lutfile_align(header.size);
+    header.size      = lutfile_prefilter(&header, &sorted, &sorted_spec);
+  }
+
+
+  if ((fp = fopen(fname, "wb")) == NULL){
+    printf("unable to open file %s\n", fname);
+    exit(FAILURE);
+  }
+
+  fwrite(&header, sizeof(lutfile_header_t), 1, fp);
+
+  lutfile_pad(fp, header.parameters);
+  lutfile_columns(fp, parameters, header.stride);
+
+  lutfile_pad(fp, header.simulations);
+  lutfile_columns(fp, simulations, header.stride);
+
+  lutfile_pad(fp, header.stats);
+  lutfile_stats(fp, parameters);
+  lutfile_stats(fp, simulations);
+
+  if (order != NULL){
+    lutfile_pad(fp, header.order);
+    for (row=0; row<nrow; row++){
+      int32_t value = order[row];
+      fwrite(&value, sizeof(int32_t), 1, fp);
+    }
+  }
+
+  if (spectra){
+    lutfile_pad(fp, header.transform);
+    fwrite(search->offset, sizeof(float), header.nband, fp);
+    fwrite(search->scale,  sizeof(float), header.nband, fp);
+    lutfile_pad(fp, header.spectra);
+    fwrite(search->spec, sizeof(float), nrow*header.nband, fp);
+  }
+
+  if (header.flags & LUTFILE_PREFILTER){
+    lutfile_pad(fp, header.prefilter);
+    fwrite(search->index, sizeof(float), nrow, fp);
+    lutfile_pad(fp, sorted);
+    for (row=0; row<nrow; row++){
+      int32_t value = search->sorted[row];
+      fwrite(&value, sizeof(int32_t), 1, fp);
+    }
+    lutfile_pad(fp, sorted_spec);
+    fwrite(search->sorted_spec, sizeof(float), nrow*header.nband, fp);
+  }
+
+  if (ftell(fp) != header.size || ferror(fp)){
+    printf("unable to write compiled LUT %s\n", fname);
+    exit(FAILURE);
+  }
+
+  fclose(fp);
+
+  return;
+}
+
+
+/** Map a compiled LUT into memory
++++ The file is checked for its version, byte order and size. The columns
++++ are used in place, nothing is copied. The search spectra, if present,
++++ are viewed as a search LUT that can be shared with prepare_shared_search.
+--- fname:  file
++++ Return: compiled LUT
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+lutfile_t open_lutfile(char *fname){
+lutfile_t lut;
+lutfile_header_t *header = NULL;
+struct stat st;
+int64_t sorted = 0, sorted_spec = 0;
+int fd;
+
+
+  if ((fd = open(fname, O_RDONLY)) < 0 || fstat(fd, &st) != 0){
+    printf("unable to open compiled LUT %s\n", fname);
+    exit(FAILURE);
+  }
+
+  if ((size_t)st.st_size < sizeof(lutfile_header_t)){
+    printf("%s is no compiled LUT\n", fname);
+    exit(FAILURE);
+  }
+
+  lut.size = st.st_size;
+
+  if ((lut.map = mmap(NULL, lut.size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED){
+    printf("unable to map compiled LUT %s\n", fname);
+    exit(FAILURE);
+  }
+
+  close(fd);
+
+  header = lut.header = (lutfile_header_t*)lut.map;
+
+  if (memcmp(header->magic, LUTFILE_MAGIC, 8) != 0){
+    printf("%s is no compiled LUT\n", fname);
+    exit(FAILURE);
+  }
+
+  if (header->endian != LUTFILE_ENDIAN){
+    printf("compiled LUT %s was written with a different byte order\n", fname);
+    exit(FAILURE);
+  }
+
+  if (header->version != LUTFILE_VERSION){
+    printf("compiled LUT %s has version %d, expected %d. Compile it again\n",
+      fname, header->version, LUTFILE_VERSION);
+    exit(FAILURE);
+  }
+
+  if (header->size != (int64_t)lut.size || header->nrow < 1 || header->nrow > INT32_MAX ||
+      header->npar < 1 || header->nband < 1){
+    printf("compiled LUT %s is truncated or corrupt\n", fname);
+    exit(FAILURE);
+  }
+
+  if (header->stride < header->nrow*(int64_t)sizeof(float) || header->stride % LUTFILE_ALIGN != 0 ||
+      header->parameters  % LUTFILE_ALIGN != 0 || header->parameters  + header->npar*header->stride  > header->size ||
+      header->simulations % LUTFILE_ALIGN != 0 || header->simulations + header->nband*header->stride > header->size ||
+      header->stats + (int64_t)(header->npar+header->nband)*LUTFILE_NSTAT*(int64_t)sizeof(double) > header->size ||
+      ((header->flags & LUTFILE_ORDER) && header->order + header->nrow*(int64_t)sizeof(int32_t) > header->size)){
+    printf("compiled LUT %s is truncated or corrupt\n", fname);
+    exit(FAILURE);
+  }
+
+  if ((header->flags & LUTFILE_SPECTRA) && (header->metric < COST_MAE || header->metric > COST_SAM ||
+      header->transform % LUTFILE_ALIGN != 0 || header->transform + 2*header->nband*(int64_t)sizeof(float) > header->size ||
+      header->spectra   % LUTFILE_ALIGN != 0 || header->spectra + header->nrow*header->nband*(int64_t)sizeof(float) > header->size)){
+    printf("compiled LUT %s is truncated or corrupt\n", fname);
+    exit(FAILURE);
+  }
+
+  if ((header->flags & LUTFILE_PREFILTER) && (!(header->flags & LUTFILE_SPECTRA) || header->prefilter % LUTFILE_ALIGN != 0 ||
+      header->band1 < 0 || header->band1 >= header->nband || header->band2 < 0 || header->band2 >= header->nband ||
+      lutfile_prefilter(header, &sorted, &sorted_spec) > header->size)){
+    printf("compiled LUT %s is truncated or corrupt\n", fname);
+    exit(FAILURE);
+  }
+
+  lut.parameters  = (const float*)((char*)lut.map + header->parameters);
+  lut.simulations = (const float*)((char*)lut.map + header->simulations);
+  lut.stats       = (const double*)((char*)lut.map + header->stats);
+  lut.order       = (header->flags & LUTFILE_ORDER) ? (const int32_t*)((char*)lut.map + header->order) : NULL;
+
+  // the search LUT points into the read-only mapping, the kernels only read
+  memset(&lut.search, 0, sizeof(search_t));
+
+  if (header->flags & LUTFILE_SPECTRA){
+    lut.search.nrow   = header->nrow;
+    lut.search.nband  = header->nband;
+    lut.search.metric = header->metric;
+    lut.search.offset = (float*)((char*)lut.map + header->transform);
+    lut.search.scale  = lut.search.offset + header->nband;
+    lut.search.spec   = (float*)((char*)lut.map + header->spectra);
+    lut.search.shared = true;
+  }
+
+  if (header->flags & LUTFILE_PREFILTER){
+    lut.search.band1  = header->band1;
+    lut.search.band2  = header->band2;
+    lut.search.index  = (float*)((char*)lut.map + header->prefilter);
+    lut.search.sorted = (int*)((char*)lut.map + sorted);
+    lut.search.sorted_spec = (float*)((char*)lut.map + sorted_spec);
+    lut.search.shared_prefilter = true;
+  }
+
+  return lut;
+}
+
+
+/** Column statistics of a compiled LUT into a table
+--- table:  table
+--- stats:  statistics of the first column of the table
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void lutfile_stats_table(table_t *table, const double *stats){
+int col;
+
+  for (col=0; col<table->ncol; col++){
+    table->mean[col] = stats[col*LUTFILE_NSTAT];
+    table->sd[col]   = stats[col*LUTFILE_NSTAT+1];
+    table->min[col]  = stats[col*LUTFILE_NSTAT+2];
+    table->max[col]  = stats[col*LUTFILE_NSTAT+3];
+    table->sum[col]  = stats[col*LUTFILE_NSTAT+4];
+  }
+
+  return;
+}
+
+
+/** View the parameters of a compiled LUT as a float32 table
++++ The columns are not copied, the table is valid while the LUT is 
++++ mapped. The column statistics are taken from the file.
+--- lut:    compiled LUT
++++ Return: table
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+table_t lutfile_parameters(lutfile_t *lut){
+table_t table;
+
+
+  table = view_table_columns(lut->header->nrow, lut->header->npar, lut->parameters, lut->header->stride);
+  lutfile_stats_table(&table, lut->stats);
+
+  return table;
+}
+
+
+/** View the simulations of a compiled LUT as a float32 table
++++ The columns are not copied, the table is valid while the LUT is 
++++ mapped. The column statistics are taken from the file.
+--- lut:    compiled LUT
++++ Return: table
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+table_t lutfile_simulations(lutfile_t *lut){
+table_t table;
+
+
+  table = view_table_columns(lut->header->nrow, lut->header->nband, lut->simulations, lut->header->stride);
+  lutfile_stats_table(&table, lut->stats + (size_t)lut->header->npar*LUTFILE_NSTAT);
+
+  return table;
+}
+
+
+/** Unmap a compiled LUT
+--- lut:    compiled LUT
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void close_lutfile(lutfile_t *lut){
+
+  if (lut->map != NULL) munmap(lut->map, lut->size);
+
+  lut->map = NULL;
+  lut->header = NULL;
+  lut->parameters = lut->simulations = NULL;
+  lut->stats = NULL;
+  lut->order = NULL;
+  memset(&lut->search, 0, sizeof(search_t));
+
+  return;
+}
+
@@ -0,0 +1,88 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Compiled (binary) LUT header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef LUTFILE_H
+#define LUTFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "const.h"
+#include "alloc.h"
+#include "table.h"
+#include "search.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LUTFILE_MAGIC   "RSA-LUT"
+#define LUTFILE_VERSION 3
+#define LUTFILE_ENDIAN  0x01020304
+#define LUTFILE_ALIGN   64
+
+// number of statistics per column: mean, sd, min, max, sum
+#define LUTFILE_NSTAT 5
+
+// optional sections
+#define LUTFILE_ORDER     1 // stratified sampling order of the LUT rows
+#define LUTFILE_SPECTRA   2 // row-major search spectra, with their transform
+#define LUTFILE_PREFILTER 4 // prefilter of the search spectra
+
+typedef struct {
+  char magic[8];        // LUTFILE_MAGIC
+  int32_t version;      // LUTFILE_VERSION
+  int32_t endian;       // LUTFILE_ENDIAN in the byte order of the writer
+  int32_t flags;        // optional sections that are present
+  int32_t npar;         // number of parameters
+  int32_t nband;        // number of simulated bands
+  int32_t metric;       // cost function of the search spectra
+  int64_t nrow;         // number of LUT rows
+  int64_t size;         // file size in bytes
+  int64_t parameters;   // offset of parameter columns, npar x stride
+  int64_t simulations;  // offset of simulation columns, nband x stride
+  int64_t stats;        // offset of column statistics, (npar+nband) x 5 double
+  int64_t order;        // offset of sampling order, nrow int32, or 0
+  int64_t stride;       // distance between columns in bytes, aligned
+  int64_t transform;    // offset of band offsets and scales, 2 x nband float, or 0
+  int64_t spectra;      // offset of search spectra, nrow x nband float, or 0
+  int64_t prefilter;    // offset of prefilter index, sorted rows and spectra, or 0
+  int32_t band1;        // first band of prefilter index
+  int32_t band2;        // second band of prefilter index
+  char padding[8];      // header is 128 bytes
+} lutfile_header_t;
+
+typedef struct {
+  void *map;                // mapped file
+  size_t size;              // mapped bytes
+  lutfile_header_t *header; // file header
+  const float *parameters;  // parameter columns
+  const float *simulations; // simulation columns
+  const double *stats;      // column statistics
+  const int32_t *order;     // sampling order, or NULL
+  search_t search;          // view of search spectra and prefilter, spec is NULL if absent
+} lutfile_t;
+
+bool is_lutfile(char *fname);
+void write_lutfile(char *fname, table_t *parameters, table_t *simulations, const search_t *search);
+lutfile_t open_lutfile(char *fname);
+table_t lutfile_parameters(lutfile_t *lut);
+table_t lutfile_simulations(lutfile_t *lut);
+void close_lutfile(lutfile_t *lut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
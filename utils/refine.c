@@ -0,0 +1,254 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for refining a LUT inversion between the
+LUT nodes, using the best few LUT rows of a pixel
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "refine.h"
+
+
+/** Inverse-distance weights
+--- cost:   cost of neighbours, ascending
+--- n:      number of neighbours
+--- weight: weights (returned)
++++ Return: sum of weights
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static double refine_weights(const float *cost, int n, double *weight){
+double eps = 1e-6*(double)cost[n-1]*cost[n-1] + DBL_MIN;
+double sum = 0;
+int j;
+
+  for (j=0; j<n; j++){
+    weight[j] = 1.0 / ((double)cost[j]*cost[j] + eps);
+    sum += weight[j];
+  }
+
+  return sum;
+}
+
+
+/** Weighted standard deviation of the neighbours around the estimate
+--- param:    parameters of neighbours, n x npar
+--- cost:     cost of neighbours, ascending
+--- n:        number of neighbours
+--- npar:     number of parameters
+--- estimate: estimated parameters
+--- spread:   spread of parameters (returned)
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void refine_spread(const float *param, const float *cost, int n, int npar, const float *estimate, float *spread){
+double weight[n];
+double sum, d, v;
+int j, o;
+
+  sum = refine_weights(cost, n, weight);
+
+  for (o=0; o<npar; o++){
+    for (j=0, v=0; j<n; j++){
+      d = param[j*npar+o] - estimate[o];
+      v += weight[j]*d*d;
+    }
+    spread[o] = sqrt(v/sum);
+  }
+
+  return;
+}
+
+
+/** Cholesky decomposition of a symmetric positive definite matrix
+--- a:      matrix, n x n, lower triangle is replaced by the factor
+--- n:      dimension
++++ Return: false if the matrix is not positive definite
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static bool cholesky(double *a, int n){
+double s;
+int i, j, k;
+
+  for (j=0; j<n; j++){
+
+    for (k=0, s=a[j*n+j]; k<j; k++) s -= a[j*n+k]*a[j*n+k];
+    if (s <= 0) return false;
+    a[j*n+j] = sqrt(s);
+
+    for (i=j+1; i<n; i++){
+      for (k=0, s=a[i*n+j]; k<j; k++) s -= a[i*n+k]*a[j*n+k];
+      a[i*n+j] = s / a[j*n+j];
+    }
+
+  }
+
+  return true;
+}
+
+
+/** Solve with a Cholesky factor
+--- l:      factor, as returned by cholesky
+--- n:      dimension
+--- b:      right-hand side, replaced by the solution
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void cholesky_solve(const double *l, int n, double *b){
+int i, k;
+
+  for (i=0; i<n; i++){
+    for (k=0; k<i; k++) b[i] -= l[i*n+k]*b[k];
+    b[i] /= l[i*n+i];
+  }
+
+  for (i=n-1; i>=0; i--){
+    for (k=i+1; k<n; k++) b[i] -= l[k*n+i]*b[k];
+    b[i] /= l[i*n+i];
+  }
+
+  return;
+}
+
+
+/** Size of the workspace of refine_linear
+--- nband:  number of bands
+--- npar:   number of parameters
++++ Return: number of doubles
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t refine_work(int nband, int npar){
+
+  return (size_t)npar*(2*npar + nband + 2) + nband;
+}
+
+
+/** Inverse-distance weighting of the best LUT rows
++++ The parameters of the neighbours are weighted by their inverse
++++ squared cost, such that the estimate moves towards the neighbours
++++ that fit the pixel best.
+--- param:    parameters of neighbours, n x npar
+--- cost:     cost of neighbours, ascending
+--- n:        number of neighbours
+--- npar:     number of parameters
+--- estimate: estimated parameters (returned)
+--- spread:   weighted standard deviation of parameters (returned)
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void refine_idw(const float *param, const float *cost, int n, int npar, float *estimate, float *spread){
+double weight[n];
+double sum, v;
+int j, o;
+
+
+  sum = refine_weights(cost, n, weight);
+
+  for (o=0; o<npar; o++){
+    for (j=0, v=0; j<n; j++) v += weight[j]*param[j*npar+o];
+    estimate[o] = v/sum;
+  }
+
+  refine_spread(param, cost, n, npar, estimate, spread);
+
+  return;
+}
+
+
+/** Local linear refinement of the best LUT rows
++++ Around the best row, the simulated spectra are approximated as a 
++++ linear function of the parameters, fitted by least squares to the
++++ neighbours. This model is then solved for the parameters that best
++++ reproduce the pixel spectrum. Parameters are standardized for the 
++++ fit, and both solves are slightly regularized, such that parameters
++++ that do not vary among the neighbours are kept. The estimate is
++++ limited to the range of the neighbours.
+--- x:        transformed pixel spectrum
+--- spec:     transformed spectra of neighbours, n x nband
+--- param:    parameters of neighbours, n x npar
+--- cost:     cost of neighbours, ascending
+--- n:        number of neighbours
+--- nband:    number of bands
+--- npar:     number of parameters
+--- work:     workspace, refine_work doubles
+--- estimate: estimated parameters (returned)
+--- spread:   weighted standard deviation of parameters (returned)
++++ Return:   false if the fit is not determined
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool refine_linear(const float *x, const float *spec, const float *param, const float *cost, int n, int nband, int npar, double *work, float *estimate, float *spread){
+double *sd = work;
+double *a  = sd + npar;             // normal matrix of parameters, npar x npar
+double *jt = a  + npar*npar;        // transposed Jacobian, npar x nband
+double *m  = jt + (size_t)npar*nband; // normal matrix of Jacobian, npar x npar
+double *g  = m  + npar*npar;        // npar
+double *col = g + npar;             // nband
+double d, trace, lo, hi;
+int j, o, p, b;
+
+
+  if (n <= npar) return false;
+
+  // standardize parameter differences to the best row
+  for (o=0; o<npar; o++){
+    for (j=1, sd[o]=0; j<n; j++){
+      d = param[j*npar+o] - param[o];
+      sd[o] += d*d;
+    }
+    sd[o] = sqrt(sd[o]/(n-1));
+  }
+
+  // least-squares fit of spectral differences against parameter differences
+  for (o=0; o<npar; o++){
+    for (p=0; p<npar; p++){
+      for (j=1, d=0; j<n; j++){
+        if (sd[o] > 0 && sd[p] > 0) d += (param[j*npar+o] - param[o])/sd[o] * (param[j*npar+p] - param[p])/sd[p];
+      }
+      a[o*npar+p] = d;
+    }
+    a[o*npar+o] += 1e-6*(n-1);
+  }
+
+  for (o=0; o<npar; o++){
+    for (b=0; b<nband; b++){
+      for (j=1, d=0; j<n; j++){
+        if (sd[o] > 0) d += (param[j*npar+o] - param[o])/sd[o] * (spec[j*nband+b] - spec[b]);
+      }
+      jt[o*nband+b] = d;
+    }
+  }
+
+  if (!cholesky(a, npar)) return false;
+
+  for (b=0; b<nband; b++){
+    for (o=0; o<npar; o++) col[o] = jt[o*nband+b];
+    cholesky_solve(a, npar, col);
+    for (o=0; o<npar; o++) jt[o*nband+b] = col[o];
+  }
+
+  // solve the linear model for the pixel
+  for (o=0, trace=0; o<npar; o++){
+    for (p=0; p<npar; p++){
+      for (b=0, d=0; b<nband; b++) d += jt[o*nband+b]*jt[p*nband+b];
+      m[o*npar+p] = d;
+    }
+    for (b=0, d=0; b<nband; b++) d += jt[o*nband+b]*(x[b] - spec[b]);
+    g[o] = d;
+    trace += m[o*npar+o];
+  }
+
+  if (trace <= 0) return false;
+
+  for (o=0; o<npar; o++) m[o*npar+o] += 1e-6*trace/npar;
+
+  if (!cholesky(m, npar)) return false;
+  cholesky_solve(m, npar, g);
+
+  for (o=0; o<npar; o++){
+
+    lo = hi = param[o];
+    for (j=1; j<n; j++){
+      if (param[j*npar+o] < lo) lo = param[j*npar+o];
+      if (param[j*npar+o] > hi) hi = param[j*npar+o];
+    }
+
+    d = param[o] + g[o]*sd[o];
+    estimate[o] = (d < lo) ? lo : (d > hi) ? hi : d;
+
+  }
+
+  refine_spread(param, cost, n, npar, estimate, spread);
+
+  return true;
+}
+
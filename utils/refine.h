@@ -0,0 +1,31 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Local refinement header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef REFINE_H
+#define REFINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <float.h>
+#include <math.h>
+
+#include "const.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t refine_work(int nband, int npar);
+void refine_idw(const float *param, const float *cost, int n, int npar, float *estimate, float *spread);
+bool refine_linear(const float *x, const float *spec, const float *param, const float *cost, int n, int nband, int npar, double *work, float *estimate, float *spread);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,1171 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for searching the best-fitting simulation
+of a LUT for a pixel spectrum
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "search.h"
+
+
+/** Normalize a spectrum in place
+--- search: search LUT
+--- x:      spectrum (modified)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void search_normalize(search_t *search, float *x){
+float norm = 0;
+int b;
+
+  for (b=0; b<search->nband; b++) x[b] = (x[b] - search->offset[b]) * search->scale[b];
+
+  if (search->metric != COST_SAM) return;
+
+  for (b=0; b<search->nband; b++) norm += x[b]*x[b];
+  if (norm <= 0) return;
+
+  norm = 1.0/sqrtf(norm);
+  for (b=0; b<search->nband; b++) x[b] *= norm;
+
+  return;
+}
+
+
+/** Number of LUT rows that occupy about half of the L2 cache
+--- nband:  number of bands
++++ Return: number of rows
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static int search_chunk(int nband){
+long l2 = 0;
+int chunk;
+
+  #ifdef _SC_LEVEL2_CACHE_SIZE
+  l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  #endif
+  if (l2 <= 0) l2 = NPOW_08*NPOW_10;
+
+  chunk = l2 / 2 / (nband*sizeof(float));
+  if (chunk < NPOW_06) chunk = NPOW_06;
+
+  return chunk;
+}
+
+
+/** Band offsets and scales of a search LUT
+--- search:      search LUT
+--- simulations: simulated spectra, only the column statistics are used
+--- zscore:      normalize bands with mean and standard deviation of LUT
+--- weight:      band weights, or NULL
++++ Return:      void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void search_scaling(search_t *search, table_t *simulations, bool zscore, const float *weight){
+int b;
+
+  alloc((void**)&search->offset, search->nband, sizeof(float));
+  alloc((void**)&search->scale,  search->nband, sizeof(float));
+
+  // x' = (x - offset) * scale, squared costs need the root of the weight
+  for (b=0; b<search->nband; b++){
+    search->offset[b] = zscore ? simulations->mean[b] : 0;
+    search->scale[b]  = (zscore && simulations->sd[b] > 0) ? 1.0/simulations->sd[b] : 1;
+    if (weight != NULL) search->scale[b] *= cost_squared(search->metric) ? sqrtf(weight[b]) : weight[b];
+  }
+
+  return;
+}
+
+
+/** Prepare LUT for searching
++++ This function copies the simulations into one contiguous float block,
++++ and sizes the LUT chunks of the blocked kernel, such that one chunk
++++ occupies about half of the L2 cache. Band normalization and weights 
++++ are folded into the LUT here, such that the kernels do not need to 
++++ apply them per LUT row. Pixels need to be transformed in the same way
++++ with search_transform. For SAM, the spectra are scaled to unit length.
++++ The simulations may be stored as doubles or float32 columns.
+--- simulations: simulated spectra
+--- metric:      cost function
+--- zscore:      normalize bands with mean and standard deviation of LUT
+--- weight:      band weights, or NULL
++++ Return:      search LUT
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+search_t prepare_search(table_t *simulations, int metric, bool zscore, const float *weight){
+
+  return prepare_shared_search(simulations, metric, zscore, weight, NULL);
+}
+
+
+/** Prepare LUT for searching, with spectra that were transformed before
++++ Same as prepare_search, but if shared holds spectra that were trans-
++++ formed with the same cost function, offsets and scales, e.g. mapped 
++++ from a compiled LUT, they are used in place instead of being copied.
++++ The prefilter of shared is used in place as well. Otherwise, the 
++++ spectra are copied as in prepare_search.
+--- simulations: simulated spectra
+--- metric:      cost function
+--- zscore:      normalize bands with mean and standard deviation of LUT
+--- weight:      band weights, or NULL
+--- shared:      transformed spectra, offsets and scales, or NULL
++++ Return:      search LUT
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+search_t prepare_shared_search(table_t *simulations, int metric, bool zscore, const float *weight, const search_t *shared){
+search_t search;
+bool match;
+int i, b;
+
+
+  search.nrow   = simulations->nrow;
+  search.nband  = simulations->ncol;
+  search.metric = metric;
+  search.order  = NULL;
+  search.index  = NULL;
+  search.sorted = NULL;
+  search.sorted_spec = NULL;
+  search.shared = false;
+  search.shared_prefilter = false;
+
+  search_scaling(&search, simulations, zscore, weight);
+
+  search.chunk = search_chunk(search.nband);
+
+  match = shared != NULL && shared->spec != NULL && shared->metric == metric && 
+          shared->nrow == search.nrow && shared->nband == search.nband;
+
+  for (b=0; match && b<search.nband; b++){
+    match = shared->offset[b] == search.offset[b] && shared->scale[b] == search.scale[b];
+  }
+
+  if (match){
+    search.spec   = shared->spec;
+    search.shared = true;
+    if (shared->index != NULL){
+      search.band1  = shared->band1;
+      search.band2  = shared->band2;
+      search.index  = shared->index;
+      search.sorted = shared->sorted;
+      search.sorted_spec = shared->sorted_spec;
+      search.shared_prefilter = true;
+    }
+    return search;
+  }
+
+  alloc((void**)&search.spec, (size_t)search.nrow*search.nband, sizeof(float));
+
+  #pragma omp parallel for private(b) schedule(static)
+  for (i=0; i<search.nrow; i++){
+    for (b=0; b<search.nband; b++) search.spec[(size_t)i*search.nband+b] = table_get(simulations, i, b);
+    search_normalize(&search, search.spec + (size_t)i*search.nband);
+  }
+
+  return search;
+}
+
+
+/** Allocate search LUT for streaming
++++ This function allocates an empty search LUT, which is filled chunk by 
++++ chunk with load_search. As the LUT is never seen as a whole, z-score
++++ normalization is not available.
+--- nrow:   maximum number of LUT rows per chunk
+--- nband:  number of bands
+--- metric: cost function
+--- weight: band weights, or NULL
++++ Return: search LUT
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+search_t allocate_search(int nrow, int nband, int metric, const float *weight){
+search_t search;
+int b;
+
+
+  memset(&search, 0, sizeof(search_t));
+
+  search.nrow   = 0;
+  search.nband  = nband;
+  search.metric = metric;
+  search.chunk  = search_chunk(nband);
+
+  alloc((void**)&search.offset, nband, sizeof(float));
+  alloc((void**)&search.scale,  nband, sizeof(float));
+
+  for (b=0; b<nband; b++){
+    search.offset[b] = 0;
+    search.scale[b]  = 1;
+    if (weight != NULL) search.scale[b] *= cost_squared(metric) ? sqrtf(weight[b]) : weight[b];
+  }
+
+  alloc((void**)&search.spec, (size_t)nrow*nband, sizeof(float));
+
+  return search;
+}
+
+
+/** Load a chunk of simulations into a search LUT
+--- search: search LUT, as allocated by allocate_search
+--- data:   simulated spectra, nrow x nband, row-major
+--- nrow:   number of rows, at most as allocated
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void load_search(search_t *search, const float *data, int nrow){
+int i;
+
+  search->nrow = nrow;
+
+  memcpy(search->spec, data, (size_t)nrow*search->nband*sizeof(float));
+
+  for (i=0; i<nrow; i++) search_normalize(search, search->spec + (size_t)i*search->nband);
+
+  return;
+}
+
+
+/** Transform a pixel spectrum for searching
++++ This function applies the band normalization and weights of the LUT
++++ to a pixel spectrum, and scales it to unit length for SAM.
+--- search: search LUT
+--- key:    pixel spectrum
+--- x:      transformed spectrum (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void search_transform(search_t *search, const short *key, float *x){
+int b;
+
+  for (b=0; b<search->nband; b++) x[b] = key[b];
+
+  search_normalize(search, x);
+
+  return;
+}
+
+
+/** Cost of one LUT row
+--- search: search LUT
+--- x:      transformed pixel spectrum
+--- row:    LUT row
++++ Return: cost
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float search_cost(search_t *search, const float *x, int row){
+const float *s = search->spec + (size_t)row*search->nband;
+int sq = cost_squared(search->metric);
+float sum = 0;
+int b;
+
+  for (b=0; b<search->nband; b++) sum += cost_term(x[b] - s[b], sq);
+
+  return cost_from_sum(search->metric, sum, search->nband);
+}
+
+
+/** Brute-force search for one pixel
++++ This function can be warm-started with a known LUT row, e.g. the best
++++ row of a neighbouring pixel. Its cost is a bound, and rows are aban-
++++ doned as soon as their partial cost exceeds the bound. The tighter the
++++ bound, the earlier rows are abandoned.
+--- search: search LUT
+--- x:      pixel spectrum
+--- best:   warm-start row, or -1
+--- cost:   cost of warm-start row, or FLT_MAX (in), 
+            cost of best simulation (out)
+--- sq:     squared (1) or absolute (0) differences
++++ Return: best LUT row
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline int search_brute_(search_t *search, const float *x, int best, float *cost, const int sq){
+const float *s = NULL;
+float sum, min_sum;
+int i, b, i_min = best;
+
+
+  min_sum = (*cost < FLT_MAX) ? cost_to_sum(search->metric, *cost, search->nband) : FLT_MAX;
+
+  for (i=0; i<search->nrow; i++){
+
+    s = search->spec + (size_t)i*search->nband;
+    sum = 0;
+
+    for (b=0; b<search->nband; b++){
+      sum += cost_term(x[b] - s[b], sq);
+      if ((b & 1) && sum >= min_sum) break;
+    }
+
+    if (sum < min_sum){ min_sum = sum; i_min = i; }
+
+  }
+
+  if (i_min >= 0 && i_min != best) *cost = cost_from_sum(search->metric, min_sum, search->nband);
+
+  return i_min;
+}
+
+
+// specialized kernels for absolute and squared differences
+int search_brute(search_t *search, const float *x, int best, float *cost){
+
+  if (cost_squared(search->metric)) return search_brute_(search, x, best, cost, 1);
+  return search_brute_(search, x, best, cost, 0);
+}
+
+
+/** k-best brute-force search for one pixel
++++ This function keeps the k best LUT rows in a bounded max-heap. Once
++++ the heap is full, its root is the bound for abandoning rows.
+--- search: search LUT
+--- x:      pixel spectrum
+--- k:      number of rows to keep
+--- row:    best LUT rows, sorted by ascending cost (returned)
+--- cost:   cost of best LUT rows (returned)
+--- sq:     squared (1) or absolute (0) differences
++++ Return: number of rows found
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline int search_brute_k_(search_t *search, const float *x, int k, int *row, float *cost, const int sq){
+const float *s = NULL;
+float sum, max_sum = FLT_MAX;
+int i, b, n = 0;
+
+
+  for (i=0; i<search->nrow; i++){
+
+    s = search->spec + (size_t)i*search->nband;
+    sum = 0;
+
+    for (b=0; b<search->nband; b++){
+      sum += cost_term(x[b] - s[b], sq);
+      if ((b & 1) && sum >= max_sum) break;
+    }
+
+    if (sum < max_sum){
+      heap_push(cost, row, &n, k, sum, i);
+      if (n == k) max_sum = cost[0];
+    }
+
+  }
+
+  heap_sort(cost, row, n);
+  for (i=0; i<n; i++) cost[i] = cost_from_sum(search->metric, cost[i], search->nband);
+
+  return n;
+}
+
+
+// specialized kernels for absolute and squared differences
+int search_brute_k(search_t *search, const float *x, int k, int *row, float *cost){
+
+  if (cost_squared(search->metric)) return search_brute_k_(search, x, k, row, cost, 1);
+  return search_brute_k_(search, x, k, row, cost, 0);
+}
+
+
+/** Search one tile of pixels against a chunk of LUT rows
++++ The pixels of the tile are stored band-major, such that the inner
++++ loop runs over the pixels at full vector width. The running minima
++++ are updated in place.
+--- search:  search LUT
+--- r0:      first LUT row of chunk
+--- r1:      last LUT row of chunk (excluded)
+--- x:       tile of pixels, nband x SEARCH_TILE
+--- min_sum: running minimum of summed absolute errors (updated)
+--- min_row: running best LUT row (updated)
+--- sq:      squared (1) or absolute (0) differences
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline void search_tile(search_t *search, int r0, int r1, const float *x, float *min_sum, int *min_row, const int sq){
+const float *s = NULL, *xb = NULL;
+float acc[SEARCH_TILE];
+float sb;
+int r, b, p;
+
+
+  for (r=r0; r<r1; r++){
+
+    s = search->spec + (size_t)r*search->nband;
+
+    for (p=0; p<SEARCH_TILE; p++) acc[p] = 0;
+
+    for (b=0; b<search->nband; b++){
+      sb = s[b];
+      xb = x + b*SEARCH_TILE;
+      for (p=0; p<SEARCH_TILE; p++) acc[p] += cost_term(xb[p] - sb, sq);
+    }
+
+    for (p=0; p<SEARCH_TILE; p++){
+      min_row[p] = (acc[p] < min_sum[p]) ? r : min_row[p];
+      min_sum[p] = (acc[p] < min_sum[p]) ? acc[p] : min_sum[p];
+    }
+
+  }
+
+  return;
+}
+
+
+/** Search one tile of pixels against a chunk of LUT rows, k-best
++++ Same as search_tile, but the k best rows of each pixel are kept in a
++++ bounded max-heap. The costs are computed at full vector width, only
++++ rows that beat the heap root are pushed.
+--- search:   search LUT
+--- r0:       first LUT row of chunk
+--- r1:       last LUT row of chunk (excluded)
+--- x:        tile of pixels, nband x SEARCH_TILE
+--- k:        number of rows to keep
+--- heap_sum: heap of summed absolute errors, SEARCH_TILE x k (updated)
+--- heap_row: heap of LUT rows, SEARCH_TILE x k (updated)
+--- heap_n:   number of heap entries (updated)
+--- bound:    heap root, or FLT_MAX if heap is not full (updated)
+--- sq:       squared (1) or absolute (0) differences
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline void search_tile_k(search_t *search, int r0, int r1, const float *x, int k, float *heap_sum, int *heap_row, int *heap_n, float *bound, const int sq){
+const float *s = NULL, *xb = NULL;
+float acc[SEARCH_TILE];
+float sb;
+int r, b, p, any;
+
+
+  for (r=r0; r<r1; r++){
+
+    s = search->spec + (size_t)r*search->nband;
+
+    for (p=0; p<SEARCH_TILE; p++) acc[p] = 0;
+
+    for (b=0; b<search->nband; b++){
+      sb = s[b];
+      xb = x + b*SEARCH_TILE;
+      for (p=0; p<SEARCH_TILE; p++) acc[p] += cost_term(xb[p] - sb, sq);
+    }
+
+    // vectorized test if any pixel improves, before pushing pixel-wise
+    any = 0;
+    for (p=0; p<SEARCH_TILE; p++) any |= (acc[p] < bound[p]);
+    if (!any) continue;
+
+    for (p=0; p<SEARCH_TILE; p++){
+      if (acc[p] < bound[p]){
+        heap_push(heap_sum + p*k, heap_row + p*k, heap_n + p, k, acc[p], r);
+        if (heap_n[p] == k) bound[p] = heap_sum[p*k];
+      }
+    }
+
+  }
+
+  return;
+}
+
+
+/** Cache-blocked brute-force search for many pixels
++++ This function searches a batch of pixels against the whole LUT. The
++++ LUT is processed in chunks that stay resident in L2 cache, and each
++++ chunk is applied to all tiles of the batch before the next chunk is
++++ loaded. Thus, the LUT is streamed from memory once per batch instead
++++ of once per pixel.
+--- search: search LUT
+--- x:      pixel spectra, npix x nband, pixel-major
+--- npix:   number of pixels
+--- best:   best LUT row per pixel (returned)
+--- cost:   cost of best simulation per pixel (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void search_blocked(search_t *search, const float *x, int npix, int *best, float *cost){
+int p;
+
+
+  for (p=0; p<npix; p++){ best[p] = -1; cost[p] = FLT_MAX; }
+
+  search_blocked_running(search, x, npix, 0, best, cost);
+
+  for (p=0; p<npix; p++) cost[p] = cost_from_sum(search->metric, cost[p], search->nband);
+
+  return;
+}
+
+
+/** Cache-blocked brute-force search with running minima
++++ Same as search_blocked, but the best rows and their summed band terms
++++ are carried over from previous calls. This is used for LUTs that are
++++ streamed in chunks, where the search LUT holds rows row0 onwards.
+--- search: search LUT
+--- x:      pixel spectra, npix x nband, pixel-major
+--- npix:   number of pixels
+--- row0:   LUT row of the first search LUT row
+--- best:   best LUT row per pixel, or -1 (updated)
+--- sum:    summed band terms of best row, or FLT_MAX (updated)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void search_blocked_running(search_t *search, const float *x, int npix, int row0, int *best, float *sum){
+int sq = cost_squared(search->metric);
+int ntile = (npix + SEARCH_TILE - 1) / SEARCH_TILE;
+int tile_size = search->nband*SEARCH_TILE;
+float *tiles = NULL, *min_sum = NULL;
+int *min_row = NULL;
+int r0, r1, t, p, b;
+
+
+  alloc((void**)&tiles,   (size_t)ntile*tile_size,   sizeof(float));
+  alloc((void**)&min_sum, (size_t)ntile*SEARCH_TILE, sizeof(float));
+  alloc((void**)&min_row, (size_t)ntile*SEARCH_TILE, sizeof(int));
+
+  // transpose pixels into band-major tiles
+  for (p=0; p<npix; p++){
+    for (b=0; b<search->nband; b++){
+      tiles[(size_t)(p/SEARCH_TILE)*tile_size + b*SEARCH_TILE + p%SEARCH_TILE] = x[(size_t)p*search->nband+b];
+    }
+  }
+
+  for (p=0; p<ntile*SEARCH_TILE; p++){ min_sum[p] = FLT_MAX; min_row[p] = -1; }
+  for (p=0; p<npix; p++){ min_sum[p] = sum[p]; min_row[p] = best[p] - row0; }
+
+  for (r0=0; r0<search->nrow; r0+=search->chunk){
+
+    r1 = r0 + search->chunk;
+    if (r1 > search->nrow) r1 = search->nrow;
+
+    for (t=0; t<ntile; t++){
+      if (sq){
+        search_tile(search, r0, r1, tiles + (size_t)t*tile_size,
+          min_sum + (size_t)t*SEARCH_TILE, min_row + (size_t)t*SEARCH_TILE, 1);
+      } else {
+        search_tile(search, r0, r1, tiles + (size_t)t*tile_size,
+          min_sum + (size_t)t*SEARCH_TILE, min_row + (size_t)t*SEARCH_TILE, 0);
+      }
+    }
+
+  }
+
+  for (p=0; p<npix; p++){
+    best[p] = min_row[p] + row0;
+    sum[p]  = min_sum[p];
+  }
+
+  free((void*)tiles);
+  free((void*)min_sum);
+  free((void*)min_row);
+
+  return;
+}
+
+
+/** Cache-blocked k-best brute-force search for many pixels
++++ Same as search_blocked, but the k best rows of each pixel are kept.
+--- search: search LUT
+--- x:      pixel spectra, npix x nband, pixel-major
+--- npix:   number of pixels
+--- k:      number of rows to keep
+--- best:   best LUT rows per pixel, npix x k, sorted by ascending cost,
+            -1 if LUT has less than k rows (returned)
+--- cost:   cost of best LUT rows per pixel, npix x k (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void search_blocked_k(search_t *search, const float *x, int npix, int k, int *best, float *cost){
+int sq = cost_squared(search->metric);
+int ntile = (npix + SEARCH_TILE - 1) / SEARCH_TILE;
+int tile_size = search->nband*SEARCH_TILE;
+float *tiles = NULL, *heap_sum = NULL, *bound = NULL;
+int *heap_row = NULL, *heap_n = NULL;
+int r0, r1, t, p, b, j;
+
+
+  alloc((void**)&tiles,    (size_t)ntile*tile_size,     sizeof(float));
+  alloc((void**)&heap_sum, (size_t)ntile*SEARCH_TILE*k, sizeof(float));
+  alloc((void**)&heap_row, (size_t)ntile*SEARCH_TILE*k, sizeof(int));
+  alloc((void**)&heap_n,   (size_t)ntile*SEARCH_TILE,   sizeof(int));
+  alloc((void**)&bound,    (size_t)ntile*SEARCH_TILE,   sizeof(float));
+
+  // transpose pixels into band-major tiles
+  for (p=0; p<npix; p++){
+    for (b=0; b<search->nband; b++){
+      tiles[(size_t)(p/SEARCH_TILE)*tile_size + b*SEARCH_TILE + p%SEARCH_TILE] = x[(size_t)p*search->nband+b];
+    }
+  }
+
+  for (p=0; p<ntile*SEARCH_TILE; p++) bound[p] = FLT_MAX;
+
+  for (r0=0; r0<search->nrow; r0+=search->chunk){
+
+    r1 = r0 + search->chunk;
+    if (r1 > search->nrow) r1 = search->nrow;
+
+    for (t=0; t<ntile; t++){
+      if (sq){
+        search_tile_k(search, r0, r1, tiles + (size_t)t*tile_size, k,
+          heap_sum + (size_t)t*SEARCH_TILE*k, heap_row + (size_t)t*SEARCH_TILE*k, 
+          heap_n + (size_t)t*SEARCH_TILE, bound + (size_t)t*SEARCH_TILE, 1);
+      } else {
+        search_tile_k(search, r0, r1, tiles + (size_t)t*tile_size, k,
+          heap_sum + (size_t)t*SEARCH_TILE*k, heap_row + (size_t)t*SEARCH_TILE*k, 
+          heap_n + (size_t)t*SEARCH_TILE, bound + (size_t)t*SEARCH_TILE, 0);
+      }
+    }
+
+  }
+
+  for (p=0; p<npix; p++){
+    heap_sort(heap_sum + (size_t)p*k, heap_row + (size_t)p*k, heap_n[p]);
+    for (j=0; j<k; j++){
+      if (j < heap_n[p]){
+        best[(size_t)p*k+j] = heap_row[(size_t)p*k+j];
+        cost[(size_t)p*k+j] = cost_from_sum(search->metric, heap_sum[(size_t)p*k+j], search->nband);
+      } else {
+        best[(size_t)p*k+j] = -1;
+        cost[(size_t)p*k+j] = FLT_MAX;
+      }
+    }
+  }
+
+  free((void*)tiles);
+  free((void*)heap_sum);
+  free((void*)heap_row);
+  free((void*)heap_n);
+  free((void*)bound);
+
+  return;
+}
+
+
+/** Compare two sort keys
++++ This function is used by qsort to sort rows by key in ascending order.
++++ Ties are sorted by row.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+typedef struct {
+  uint64_t key;
+  int row;
+} sort_key_t;
+
+static int cmp_sort_key(const void *a, const void *b){
+const sort_key_t *ka = (const sort_key_t*)a;
+const sort_key_t *kb = (const sort_key_t*)b;
+
+  if (ka->key < kb->key) return -1;
+  if (ka->key > kb->key) return  1;
+  return (ka->row > kb->row) - (ka->row < kb->row);
+}
+
+
+/** Compare two values
++++ This function is used by qsort to sort rows by value in ascending 
++++ order. Ties are sorted by row.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+typedef struct {
+  double value;
+  int row;
+} sort_value_t;
+
+static int cmp_sort_value(const void *a, const void *b){
+const sort_value_t *va = (const sort_value_t*)a;
+const sort_value_t *vb = (const sort_value_t*)b;
+
+  if (va->value < vb->value) return -1;
+  if (va->value > vb->value) return  1;
+  return (va->row > vb->row) - (va->row < vb->row);
+}
+
+
+/** Prepare stratified sampling order
++++ This function computes a permutation of the LUT rows, such that every
++++ run of consecutive entries covers the parameter space evenly. Each 
++++ parameter is converted to ranks, which are quantized into 2^q strata
++++ (Latin-hypercube style, all strata are equally populated). The strata
++++ of all parameters are interleaved into a Morton (Z-order) code, and 
++++ the rows are sorted by the bit-reversed code. Thus, consecutive rows 
++++ differ in the coarsest strata first, and fill in finer strata later.
+--- search: search LUT (order is set)
+--- lut:    LUT parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void prepare_sampling(search_t *search, table_t *lut){
+int npar = lut->ncol;
+int nbit, q, i, j, k;
+uint64_t *code = NULL;
+uint64_t rev;
+sort_value_t *values = NULL;
+sort_key_t *keys = NULL;
+
+
+  // bits per parameter, codes need to fit into 64bit
+  q = 64 / npar;
+  if (q > 16) q = 16;
+  if (q < 1)  q = 1;
+  nbit = q*npar;
+  if (nbit > 64){ npar = 64; nbit = 64; q = 1; }
+
+  alloc((void**)&code,   search->nrow, sizeof(uint64_t));
+  alloc((void**)&values, search->nrow, sizeof(sort_value_t));
+
+  for (j=0; j<npar; j++){
+
+    for (i=0; i<search->nrow; i++){
+      values[i].value = table_get(lut, i, j);
+      values[i].row = i;
+    }
+
+    qsort(values, search->nrow, sizeof(sort_value_t), cmp_sort_value);
+
+    // stratum of each row, interleaved from the most significant bit
+    for (i=0; i<search->nrow; i++){
+      uint64_t stratum = ((uint64_t)i << q) / search->nrow;
+      for (k=0; k<q; k++){
+        if (stratum & ((uint64_t)1 << (q-1-k))) code[values[i].row] |= (uint64_t)1 << (nbit-1 - (k*npar+j));
+      }
+    }
+
+  }
+
+  alloc((void**)&keys, search->nrow, sizeof(sort_key_t));
+
+  for (i=0; i<search->nrow; i++){
+    rev = 0;
+    for (k=0; k<nbit; k++){
+      if (code[i] & ((uint64_t)1 << k)) rev |= (uint64_t)1 << (nbit-1-k);
+    }
+    keys[i].key = rev;
+    keys[i].row = i;
+  }
+
+  qsort(keys, search->nrow, sizeof(sort_key_t), cmp_sort_key);
+
+  if (search->order != NULL) free((void*)search->order);
+  alloc((void**)&search->order, search->nrow, sizeof(int));
+  for (i=0; i<search->nrow; i++) search->order[i] = keys[i].row;
+
+  free((void*)code);
+  free((void*)values);
+  free((void*)keys);
+
+  return;
+}
+
+
+/** Stratified sampling search for one pixel
++++ This function walks the stratified sampling order without replacement,
++++ starting at a pixel-specific offset, until the accuracy is met or the
++++ maximum number of iterations is used. Rows are abandoned as soon as
++++ their partial cost exceeds the best cost found so far.
+--- search:   search LUT, with sampling order
+--- x:        pixel spectrum
+--- start:    offset into sampling order
+--- niter:    maximum number of iterations
+--- accuracy: search stops when cost is lower than this
+--- best:     warm-start row, or -1
+--- cost:     cost of warm-start row, or FLT_MAX (in),
+              cost of best simulation (out)
+--- sq:       squared (1) or absolute (0) differences
++++ Return:   best LUT row
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline int search_sample_(search_t *search, const float *x, int start, int niter, float accuracy, int best, float *cost, const int sq){
+const float *s = NULL;
+float sum, min_sum, stop_sum;
+int i, k, b, i_min = best;
+
+
+  if (niter > search->nrow) niter = search->nrow;
+
+  min_sum  = (*cost < FLT_MAX) ? cost_to_sum(search->metric, *cost, search->nband) : FLT_MAX;
+  stop_sum = cost_to_sum(search->metric, accuracy, search->nband);
+
+  for (k=0; k<niter && min_sum > stop_sum; k++){
+
+    i = search->order[(start + k) % search->nrow];
+    s = search->spec + (size_t)i*search->nband;
+    sum = 0;
+
+    for (b=0; b<search->nband; b++){
+      sum += cost_term(x[b] - s[b], sq);
+      if ((b & 1) && sum >= min_sum) break;
+    }
+
+    if (sum < min_sum){ min_sum = sum; i_min = i; }
+
+  }
+
+  if (i_min >= 0 && i_min != best) *cost = cost_from_sum(search->metric, min_sum, search->nband);
+
+  return i_min;
+}
+
+
+// specialized kernels for absolute and squared differences
+int search_sample(search_t *search, const float *x, int start, int niter, float accuracy, int best, float *cost){
+
+  if (cost_squared(search->metric)) return search_sample_(search, x, start, niter, accuracy, best, cost, 1);
+  return search_sample_(search, x, start, niter, accuracy, best, cost, 0);
+}
+
+
+/** Stratified sampling k-best search for one pixel
++++ Same as search_sample, but the k best rows are kept in a bounded max-
++++ heap. The search stops when the best row meets the accuracy.
+--- search:   search LUT, with sampling order
+--- x:        pixel spectrum
+--- start:    offset into sampling order
+--- niter:    maximum number of iterations
+--- accuracy: search stops when cost is lower than this
+--- k:        number of rows to keep
+--- row:      best LUT rows, sorted by ascending cost (returned)
+--- cost:     cost of best LUT rows (returned)
+--- sq:       squared (1) or absolute (0) differences
++++ Return:   number of rows found
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline int search_sample_k_(search_t *search, const float *x, int start, int niter, float accuracy, int k, int *row, float *cost, const int sq){
+const float *s = NULL;
+float sum, min_sum = FLT_MAX, max_sum = FLT_MAX, stop_sum;
+int i, j, b, n = 0;
+
+
+  if (niter > search->nrow) niter = search->nrow;
+
+  stop_sum = cost_to_sum(search->metric, accuracy, search->nband);
+
+  for (j=0; j<niter && min_sum > stop_sum; j++){
+
+    i = search->order[(start + j) % search->nrow];
+    s = search->spec + (size_t)i*search->nband;
+    sum = 0;
+
+    for (b=0; b<search->nband; b++){
+      sum += cost_term(x[b] - s[b], sq);
+      if ((b & 1) && sum >= max_sum) break;
+    }
+
+    if (sum < max_sum){
+      heap_push(cost, row, &n, k, sum, i);
+      if (n == k) max_sum = cost[0];
+      if (sum < min_sum) min_sum = sum;
+    }
+
+  }
+
+  heap_sort(cost, row, n);
+  for (i=0; i<n; i++) cost[i] = cost_from_sum(search->metric, cost[i], search->nband);
+
+  return n;
+}
+
+
+// specialized kernels for absolute and squared differences
+int search_sample_k(search_t *search, const float *x, int start, int niter, float accuracy, int k, int *row, float *cost){
+
+  if (cost_squared(search->metric)) return search_sample_k_(search, x, start, niter, accuracy, k, row, cost, 1);
+  return search_sample_k_(search, x, start, niter, accuracy, k, row, cost, 0);
+}
+
+
+/** Prepare spectral-index prefilter
++++ This function computes a difference index between two bands for each
++++ LUT row, e.g. NIR - red (DVI), and sorts the rows by it. The index is
++++ computed in the transformed space of the kernels. As it is linear, the
++++ index difference between a pixel and a LUT row is bounded by the cost
++++ (see search_radius), which allows an exact search over a window of the
++++ sorted rows. The spectra are copied in sorted order, such that the
++++ window is scanned contiguously.
+--- search: search LUT (prefilter is set)
+--- band1:  first band, subtracted
+--- band2:  second band
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void prepare_prefilter(search_t *search, int band1, int band2){
+sort_value_t *values = NULL;
+int i;
+
+
+  // a shared prefilter of other bands is replaced
+  free_prefilter(search);
+
+  search->band1 = band1;
+  search->band2 = band2;
+
+  alloc((void**)&values, search->nrow, sizeof(sort_value_t));
+
+  for (i=0; i<search->nrow; i++){
+    values[i].value = search->spec[(size_t)i*search->nband+band2] - 
+                      search->spec[(size_t)i*search->nband+band1];
+    values[i].row = i;
+  }
+
+  qsort(values, search->nrow, sizeof(sort_value_t), cmp_sort_value);
+
+  alloc((void**)&search->index,  search->nrow, sizeof(float));
+  alloc((void**)&search->sorted, search->nrow, sizeof(int));
+  alloc((void**)&search->sorted_spec, (size_t)search->nrow*search->nband, sizeof(float));
+
+  for (i=0; i<search->nrow; i++){
+    search->index[i]  = values[i].value;
+    search->sorted[i] = values[i].row;
+    memcpy(search->sorted_spec + (size_t)i*search->nband, 
+           search->spec + (size_t)values[i].row*search->nband, search->nband*sizeof(float));
+  }
+
+  free((void*)values);
+
+  return;
+}
+
+
+/** Suggest bands for the spectral-index prefilter
++++ The prefilter works best when the index spreads the LUT rows widely.
++++ This function picks the band pair with the largest variance of the 
++++ difference index, estimated on a regular subset of the LUT rows.
+--- search: search LUT
+--- band1:  first band (returned)
+--- band2:  second band (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void suggest_prefilter(search_t *search, int *band1, int *band2){
+int nband = search->nband;
+int step = (search->nrow > NPOW_14) ? search->nrow / NPOW_14 : 1;
+double *mean = NULL, *cov = NULL;
+double var, max = -1;
+const float *s = NULL;
+int i, n = 0, b, c;
+
+
+  alloc((void**)&mean, nband, sizeof(double));
+  alloc((void**)&cov,  nband*nband, sizeof(double));
+
+  for (i=0; i<search->nrow; i+=step){
+    s = search->spec + (size_t)i*nband;
+    for (b=0; b<nband; b++) mean[b] += s[b];
+    n++;
+  }
+  for (b=0; b<nband; b++) mean[b] /= n;
+
+  for (i=0; i<search->nrow; i+=step){
+    s = search->spec + (size_t)i*nband;
+    for (b=0; b<nband; b++){
+      for (c=b; c<nband; c++) cov[b*nband+c] += (s[b]-mean[b])*(s[c]-mean[c]);
+    }
+  }
+
+  *band1 = 0;
+  *band2 = (nband > 1) ? 1 : 0;
+
+  for (b=0; b<nband; b++){
+    for (c=b+1; c<nband; c++){
+      var = cov[b*nband+b] + cov[c*nband+c] - 2*cov[b*nband+c];
+      if (var > max){ max = var; *band1 = b; *band2 = c; }
+    }
+  }
+
+  free((void*)mean);
+  free((void*)cov);
+
+  return;
+}
+
+
+/** Index radius that can hold better rows
++++ For the index d = x2 - x1, |d(x) - d(s)| <= |x1 - s1| + |x2 - s2|. 
++++ This is at most the summed absolute differences, and at most sqrt(2)
++++ times the root of the summed squared differences (Cauchy-Schwarz). 
++++ Rows outside of this radius cannot beat the given sum.
+--- sum:    summed band terms of the best row
+--- sq:     squared (1) or absolute (0) differences
++++ Return: radius
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline float search_radius(float sum, const int sq){
+
+  if (sum == FLT_MAX) return FLT_MAX;
+
+  return sq ? sqrtf(2*sum) : sum;
+}
+
+
+/** First sorted row with an index >= value
+--- search: search LUT, with prefilter
+--- value:  index value
++++ Return: position in sorted rows
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static int search_lower_bound(search_t *search, float value){
+int lo = 0, hi = search->nrow, mid;
+
+  while (lo < hi){
+    mid = (lo + hi) / 2;
+    if (search->index[mid] < value) lo = mid + 1; else hi = mid;
+  }
+
+  return lo;
+}
+
+
+/** Spectral-index prefilter search for one pixel
++++ This function scans the LUT rows in order of increasing index distance
++++ to the pixel, starting at the binary-search position of the pixel. 
++++ The scan stops when no row within the radius of the best cost is left
++++ (search_radius), thus the result is exact. With a tolerance > 0, the 
++++ radius is additionally capped, which is approximate. The search can 
++++ be warm-started like search_brute, which shrinks the radius upfront.
+--- search:    search LUT, with prefilter
+--- x:         transformed pixel spectrum
+--- tolerance: maximum index distance, or 0 for exact search
+--- accuracy:  search stops when cost is lower than this
+--- best:      warm-start row, or -1
+--- cost:      cost of warm-start row, or FLT_MAX (in),
+               cost of best simulation (out)
+--- sq:        squared (1) or absolute (0) differences
++++ Return:    best LUT row
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline int search_prefilter_(search_t *search, const float *x, float tolerance, float accuracy, int best, float *cost, const int sq){
+const float *s = NULL;
+float sum, min_sum, stop_sum, radius, value, dl, dr;
+int l, r, i, b, i_min = -1;
+
+
+  min_sum  = (*cost < FLT_MAX) ? cost_to_sum(search->metric, *cost, search->nband) : FLT_MAX;
+  stop_sum = cost_to_sum(search->metric, accuracy, search->nband);
+
+  value = x[search->band2] - x[search->band1];
+  r = search_lower_bound(search, value);
+  l = r-1;
+
+  while (min_sum > stop_sum){
+
+    radius = search_radius(min_sum, sq);
+    if (tolerance > 0 && tolerance < radius) radius = tolerance;
+
+    if (l < 0 && r >= search->nrow) break;
+
+    dl = (l >= 0)            ? value - search->index[l] : FLT_MAX;
+    dr = (r < search->nrow)  ? search->index[r] - value : FLT_MAX;
+
+    // closer side first, stop if both sides are out of reach
+    if (dl <= dr){
+      if (dl > radius) break;
+      i = l--;
+    } else {
+      if (dr > radius) break;
+      i = r++;
+    }
+
+    s = search->sorted_spec + (size_t)i*search->nband;
+    sum = 0;
+
+    for (b=0; b<search->nband; b++){
+      sum += cost_term(x[b] - s[b], sq);
+      if ((b & 1) && sum >= min_sum) break;
+    }
+
+    if (sum < min_sum){ min_sum = sum; i_min = i; }
+
+  }
+
+  if (i_min < 0) return best;
+
+  *cost = cost_from_sum(search->metric, min_sum, search->nband);
+
+  return search->sorted[i_min];
+}
+
+
+// specialized kernels for absolute and squared differences
+int search_prefilter(search_t *search, const float *x, float tolerance, float accuracy, int best, float *cost){
+
+  if (cost_squared(search->metric)) return search_prefilter_(search, x, tolerance, accuracy, best, cost, 1);
+  return search_prefilter_(search, x, tolerance, accuracy, best, cost, 0);
+}
+
+
+/** Spectral-index prefilter k-best search for one pixel
++++ Same as search_prefilter, but the k best rows are kept in a bounded 
++++ max-heap. The radius follows the heap root, once the heap is full.
+--- search:    search LUT, with prefilter
+--- x:         transformed pixel spectrum
+--- tolerance: maximum index distance, or 0 for exact search
+--- accuracy:  search stops when the cost of the best row is lower
+--- k:         number of rows to keep
+--- row:       best LUT rows, sorted by ascending cost (returned)
+--- cost:      cost of best LUT rows (returned)
+--- sq:        squared (1) or absolute (0) differences
++++ Return:    number of rows found
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline int search_prefilter_k_(search_t *search, const float *x, float tolerance, float accuracy, int k, int *row, float *cost, const int sq){
+const float *s = NULL;
+float sum, min_sum = FLT_MAX, max_sum = FLT_MAX, stop_sum, radius, value, dl, dr;
+int l, r, i, b, n = 0;
+
+
+  stop_sum = cost_to_sum(search->metric, accuracy, search->nband);
+
+  value = x[search->band2] - x[search->band1];
+  r = search_lower_bound(search, value);
+  l = r-1;
+
+  while (min_sum > stop_sum){
+
+    radius = search_radius(max_sum, sq);
+    if (tolerance > 0 && tolerance < radius) radius = tolerance;
+
+    if (l < 0 && r >= search->nrow) break;
+
+    dl = (l >= 0)            ? value - search->index[l] : FLT_MAX;
+    dr = (r < search->nrow)  ? search->index[r] - value : FLT_MAX;
+
+    if (dl <= dr){
+      if (dl > radius) break;
+      i = l--;
+    } else {
+      if (dr > radius) break;
+      i = r++;
+    }
+
+    s = search->sorted_spec + (size_t)i*search->nband;
+    sum = 0;
+
+    for (b=0; b<search->nband; b++){
+      sum += cost_term(x[b] - s[b], sq);
+      if ((b & 1) && sum >= max_sum) break;
+    }
+
+    if (sum < max_sum){
+      heap_push(cost, row, &n, k, sum, search->sorted[i]);
+      if (n == k) max_sum = cost[0];
+      if (sum < min_sum) min_sum = sum;
+    }
+
+  }
+
+  heap_sort(cost, row, n);
+  for (i=0; i<n; i++) cost[i] = cost_from_sum(search->metric, cost[i], search->nband);
+
+  return n;
+}
+
+
+// specialized kernels for absolute and squared differences
+int search_prefilter_k(search_t *search, const float *x, float tolerance, float accuracy, int k, int *row, float *cost){
+
+  if (cost_squared(search->metric)) return search_prefilter_k_(search, x, tolerance, accuracy, k, row, cost, 1);
+  return search_prefilter_k_(search, x, tolerance, accuracy, k, row, cost, 0);
+}
+
+
+/** Free spectral-index prefilter
+--- search: search LUT
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_prefilter(search_t *search){
+
+  if (search->shared_prefilter){
+    search->index = search->sorted_spec = NULL;
+    search->sorted = NULL;
+    search->shared_prefilter = false;
+    return;
+  }
+
+  if (search->index  != NULL){ free((void*)search->index);  search->index  = NULL; }
+  if (search->sorted != NULL){ free((void*)search->sorted); search->sorted = NULL; }
+  if (search->sorted_spec != NULL){ free((void*)search->sorted_spec); search->sorted_spec = NULL; }
+
+  return;
+}
+
+
+/** Free search LUT
+--- search: search LUT
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_search(search_t *search){
+
+  if (search->spec   != NULL && !search->shared) free((void*)search->spec);
+  search->spec = NULL;
+  if (search->order  != NULL){ free((void*)search->order);  search->order  = NULL; }
+  if (search->offset != NULL){ free((void*)search->offset); search->offset = NULL; }
+  if (search->scale  != NULL){ free((void*)search->scale);  search->scale  = NULL; }
+
+  free_prefilter(search);
+
+  return;
+}
+
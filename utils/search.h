@@ -0,0 +1,76 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+LUT search header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "const.h"
+#include "alloc.h"
+#include "table.h"
+#include "heap.h"
+#include "cost.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of pixels that are processed together in the blocked kernel
+#define SEARCH_TILE 32
+
+typedef struct {
+  int nrow;      // number of LUT rows
+  int nband;     // number of bands
+  int chunk;     // number of LUT rows that fit into L2 cache
+  int metric;    // cost function
+  float *offset; // band offset, subtracted before scaling
+  float *scale;  // band scale, includes normalization and weights
+  float *spec;   // transformed simulated spectra, nrow x nband, row-major
+  int *order;    // stratified sampling order of LUT rows, or NULL
+  int band1;     // first band of prefilter index
+  int band2;     // second band of prefilter index
+  float *index;  // prefilter index of LUT rows, ascending, or NULL
+  int *sorted;   // LUT rows in ascending order of prefilter index
+  float *sorted_spec; // transformed spectra in ascending order of index
+  bool shared;   // spec is not owned, e.g. mapped from a compiled LUT
+  bool shared_prefilter; // index, sorted and sorted_spec are not owned
+} search_t;
+
+search_t prepare_search(table_t *simulations, int metric, bool zscore, const float *weight);
+search_t prepare_shared_search(table_t *simulations, int metric, bool zscore, const float *weight, const search_t *shared);
+search_t allocate_search(int nrow, int nband, int metric, const float *weight);
+void load_search(search_t *search, const float *data, int nrow);
+void search_transform(search_t *search, const short *key, float *x);
+float search_cost(search_t *search, const float *x, int row);
+int search_brute(search_t *search, const float *x, int best, float *cost);
+int search_brute_k(search_t *search, const float *x, int k, int *row, float *cost);
+void search_blocked(search_t *search, const float *x, int npix, int *best, float *cost);
+void search_blocked_running(search_t *search, const float *x, int npix, int row0, int *best, float *sum);
+void search_blocked_k(search_t *search, const float *x, int npix, int k, int *best, float *cost);
+void prepare_sampling(search_t *search, table_t *lut);
+int search_sample(search_t *search, const float *x, int start, int niter, float accuracy, int best, float *cost);
+int search_sample_k(search_t *search, const float *x, int start, int niter, float accuracy, int k, int *row, float *cost);
+void prepare_prefilter(search_t *search, int band1, int band2);
+void suggest_prefilter(search_t *search, int *band1, int *band2);
+int search_prefilter(search_t *search, const float *x, float tolerance, float accuracy, int best, float *cost);
+int search_prefilter_k(search_t *search, const float *x, float tolerance, float accuracy, int k, int *row, float *cost);
+void free_prefilter(search_t *search);
+void free_search(search_t *search);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -391,3 +391,325 @@ void linreg_predict(double x, double slope, double intercept, double *y){
   return;
 }
 
+
+
+/** Initialize moment accumulator
++++ This function initializes an empty moment accumulator.
+--- moments: moment accumulator (returned)
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void init_moments(moments_t *moments){
+
+  moments->n    = 0;
+  moments->mean = 0;
+  moments->m2   = 0;
+  moments->m3   = 0;
+  moments->m4   = 0;
+  moments->min  =  DBL_MAX;
+  moments->max  = -DBL_MAX;
+  moments->sum  = 0;
+
+  return;
+}
+
+
+/** Merge moment accumulators
++++ This function combines the moments of two disjoint sets of observa-
++++ tions with the pairwise update formulas. Accumulators of chunks that
++++ were summarized independently, e.g. by different threads, can thus be
++++ merged. The estimates can be used with the functions above, e.g. 
++++ standdev(moments->m2, moments->n) or skewness(moments->m2, 
++++ moments->m3, moments->n).
++++-----------------------------------------------------------------------
++++ P. P�bay. SANDIA REPORT SAND2008-6212 (2008). Formulas for Robust, 
++++ One-Pass Parallel Computation of Co- variances and Arbitrary-Order 
++++ Statistical Moments.
++++-----------------------------------------------------------------------
+--- moments: moment accumulator (is updated)
+--- other:   moment accumulator that is merged into moments
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void merge_moments(moments_t *moments, const moments_t *other){
+double na = moments->n, nb = other->n, n = na+nb;
+double m2 = moments->m2, m3 = moments->m3;
+double delta, delta_n, delta_n2, tmp;
+
+
+  if (nb == 0) return;
+  if (na == 0){ *moments = *other; return;}
+
+  delta = other->mean-moments->mean;
+  delta_n = delta/n;
+  delta_n2 = delta_n*delta_n;
+  tmp = delta*delta_n*na*nb;
+
+  moments->n    = n;
+  moments->mean = moments->mean + nb*delta_n;
+  moments->m4   = moments->m4 + other->m4 + tmp*delta_n2*(na*na-na*nb+nb*nb) + 
+                  6*delta_n2*(na*na*other->m2 + nb*nb*m2) + 
+                  4*delta_n*(na*other->m3 - nb*m3);
+  moments->m3   = m3 + other->m3 + tmp*delta_n*(na-nb) + 
+                  3*delta_n*(na*other->m2 - nb*m2);
+  moments->m2   = m2 + other->m2 + tmp;
+
+  if (other->min < moments->min) moments->min = other->min;
+  if (other->max > moments->max) moments->max = other->max;
+  moments->sum += other->sum;
+
+  return;
+}
+
+
+/** Summarize a batch of values
++++ This function computes the moments of a contiguous batch of values in
++++ two passes, which vectorize, and merges them into the accumulator.
+--- moments: moment accumulator (is updated)
+--- x:       values
+--- n:       number of values
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void moments_batch(moments_t *moments, const double *x, int n){
+moments_t batch;
+double sum = 0, minimum = DBL_MAX, maximum = -DBL_MAX;
+double m2 = 0, m3 = 0, m4 = 0, mean, d, d2;
+int i;
+
+
+  if (n == 0) return;
+
+  #pragma omp simd reduction(+: sum) reduction(min: minimum) reduction(max: maximum)
+  for (i=0; i<n; i++){
+    sum += x[i];
+    minimum = (x[i] < minimum) ? x[i] : minimum;
+    maximum = (x[i] > maximum) ? x[i] : maximum;
+  }
+
+  mean = sum/n;
+
+  #pragma omp simd reduction(+: m2, m3, m4) private(d, d2)
+  for (i=0; i<n; i++){
+    d  = x[i]-mean;
+    d2 = d*d;
+    m2 += d2;
+    m3 += d2*d;
+    m4 += d2*d2;
+  }
+
+  batch.n    = n;
+  batch.mean = mean;
+  batch.m2   = m2;
+  batch.m3   = m3;
+  batch.m4   = m4;
+  batch.min  = minimum;
+  batch.max  = maximum;
+  batch.sum  = sum;
+
+  merge_moments(moments, &batch);
+
+  return;
+}
+
+
+/** Update moment accumulator with an array of doubles
++++ This function adds n values to the accumulator. The values are summa-
++++ rized in batches of MOMENTS_BATCH values, which are merged into the 
++++ accumulator. A column of a row-major matrix can be given with stride.
+--- moments: moment accumulator (is updated)
+--- x:       values
+--- n:       number of values
+--- stride:  distance between values, 1 for contiguous arrays
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void update_moments(moments_t *moments, const double *x, size_t n, size_t stride){
+double batch[MOMENTS_BATCH];
+size_t i, j, nb;
+
+
+  for (i=0; i<n; i+=MOMENTS_BATCH){
+
+    nb = (n-i < MOMENTS_BATCH) ? n-i : MOMENTS_BATCH;
+
+    if (stride == 1){
+      moments_batch(moments, x+i, nb);
+    } else {
+      for (j=0; j<nb; j++) batch[j] = x[(i+j)*stride];
+      moments_batch(moments, batch, nb);
+    }
+
+  }
+
+  return;
+}
+
+
+/** Update moment accumulator with an array of floats
++++ This function adds n contiguous float values to the accumulator. The
++++ moments are computed in double precision.
+--- moments: moment accumulator (is updated)
+--- x:       values
+--- n:       number of values
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void update_moments_float(moments_t *moments, const float *x, size_t n){
+double batch[MOMENTS_BATCH];
+size_t i, j, nb;
+
+
+  for (i=0; i<n; i+=MOMENTS_BATCH){
+
+    nb = (n-i < MOMENTS_BATCH) ? n-i : MOMENTS_BATCH;
+
+    #pragma omp simd
+    for (j=0; j<nb; j++) batch[j] = x[i+j];
+    moments_batch(moments, batch, nb);
+
+  }
+
+  return;
+}
+
+
+/** Allocate time series accumulator
++++ This function allocates the moments of n pixels, which are updated 
++++ with one observation per pixel and time. The arrays are structured 
++++ per moment, so that the update runs over contiguous memory.
+--- n:      number of pixels
++++ Return: time series accumulator
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+series_t allocate_series(int n){
+series_t series;
+
+
+  series.n = n;
+
+  alloc_aligned((void**)&series.count,  n, sizeof(double));
+  alloc_aligned((void**)&series.mean,   n, sizeof(double));
+  alloc_aligned((void**)&series.m2,     n, sizeof(double));
+  alloc_aligned((void**)&series.m3,     n, sizeof(double));
+  alloc_aligned((void**)&series.m4,     n, sizeof(double));
+  alloc_aligned((void**)&series.min,    n, sizeof(double));
+  alloc_aligned((void**)&series.max,    n, sizeof(double));
+  alloc_aligned((void**)&series.mean_t, n, sizeof(double));
+  alloc_aligned((void**)&series.m2_t,   n, sizeof(double));
+  alloc_aligned((void**)&series.cov,    n, sizeof(double));
+
+  reset_series(&series);
+
+  return series;
+}
+
+
+/** Reset time series accumulator
++++ This function empties the accumulator, e.g. before the next block of
++++ pixels is processed.
+--- series: time series accumulator (is updated)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void reset_series(series_t *series){
+int i;
+
+
+  for (i=0; i<series->n; i++){
+    series->count[i]  = 0;
+    series->mean[i]   = 0;
+    series->m2[i]     = 0;
+    series->m3[i]     = 0;
+    series->m4[i]     = 0;
+    series->min[i]    =  DBL_MAX;
+    series->max[i]    = -DBL_MAX;
+    series->mean_t[i] = 0;
+    series->m2_t[i]   = 0;
+    series->cov[i]    = 0;
+  }
+
+  return;
+}
+
+
+/** Update time series accumulator
++++ This function adds the observations of one time to a range of pixels,
++++ with the recurrence formulas of kurt_recurrence and covar_recurrence.
++++ Missing observations are masked arithmetically instead of branching,
++++ so that the loop vectorizes over the pixels. Threads can update dis-
++++ joint ranges of pixels.
++++-----------------------------------------------------------------------
++++ P. P�bay. SANDIA REPORT SAND2008-6212 (2008). Formulas for Robust, 
++++ One-Pass Parallel Computation of Co- variances and Arbitrary-Order 
++++ Statistical Moments.
++++-----------------------------------------------------------------------
+--- series: time series accumulator (is updated)
+--- offset: first pixel
+--- n:      number of pixels
+--- x:      values of the pixels, x[0] belongs to the first pixel
+--- t:      time of the observations
+--- nodata: missing value, NaN is always missing
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void update_series(series_t *series, int offset, int n, const float *x, double t, float nodata){
+double *restrict count  = series->count  + offset;
+double *restrict mean   = series->mean   + offset;
+double *restrict m2     = series->m2     + offset;
+double *restrict m3     = series->m3     + offset;
+double *restrict m4     = series->m4     + offset;
+double *restrict min    = series->min    + offset;
+double *restrict max    = series->max    + offset;
+double *restrict mean_t = series->mean_t + offset;
+double *restrict m2_t   = series->m2_t   + offset;
+double *restrict cov    = series->cov    + offset;
+int i;
+
+
+  #pragma omp simd
+  for (i=0; i<n; i++){
+
+    double w = (x[i] != nodata && x[i] == x[i]) ? 1.0 : 0.0;
+    // missing values are replaced by the mean, as 0*NaN would be NaN
+    double value = (w > 0) ? x[i] : mean[i];
+    double k = count[i] + w;
+    double delta   = w*(value-mean[i]);
+    double delta_t = w*(t-mean_t[i]);
+    double delta_n = delta/((k > 0) ? k : 1.0);
+    double delta_n2 = delta_n*delta_n;
+    double tmp = delta*delta_n*count[i];
+
+    m4[i] += tmp*delta_n2*(k*k-3*k+3) + 6*delta_n2*m2[i] - 4*delta_n*m3[i];
+    m3[i] += tmp*delta_n*(k-2) - 3*delta_n*m2[i];
+    m2[i] += tmp;
+    mean[i] += delta_n;
+
+    cov[i]    += delta*delta_t*count[i]/((k > 0) ? k : 1.0);
+    m2_t[i]   += delta_t*delta_t*count[i]/((k > 0) ? k : 1.0);
+    mean_t[i] += delta_t/((k > 0) ? k : 1.0);
+
+    min[i] = (w > 0 && value < min[i]) ? value : min[i];
+    max[i] = (w > 0 && value > max[i]) ? value : max[i];
+    count[i] = k;
+
+  }
+
+  return;
+}
+
+
+/** Free time series accumulator
+--- series: time series accumulator
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_series(series_t *series){
+
+  free((void*)series->count);
+  free((void*)series->mean);
+  free((void*)series->m2);
+  free((void*)series->m3);
+  free((void*)series->m4);
+  free((void*)series->min);
+  free((void*)series->max);
+  free((void*)series->mean_t);
+  free((void*)series->m2_t);
+  free((void*)series->cov);
+
+  series->n = 0;
+
+  return;
+}
+
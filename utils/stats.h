@@ -32,6 +32,7 @@ Statistics header
 #include <stdlib.h>  // standard general utilities library
 #include <stdbool.h> // boolean data type
 #include <math.h>    // common mathematical functions
+#include <float.h>   // floating-point limits
 
 #include "const.h"
 #include "alloc.h"
@@ -41,6 +42,34 @@ Statistics header
 extern "C" {
 #endif
 
+// number of values that are summarized in one batch of a moment update
+#define MOMENTS_BATCH 1024
+
+typedef struct {
+  double n;    // number of observations
+  double mean; // mean
+  double m2;   // sum of squared deviations from the mean
+  double m3;   // sum of cubed deviations from the mean
+  double m4;   // sum of 4th power deviations from the mean
+  double min;  // minimum
+  double max;  // maximum
+  double sum;  // sum
+} moments_t;
+
+typedef struct {
+  int n;          // number of pixels
+  double *count;  // number of valid observations
+  double *mean;   // mean of values
+  double *m2;     // sum of squared deviations of values
+  double *m3;     // sum of cubed deviations of values
+  double *m4;     // sum of 4th power deviations of values
+  double *min;    // minimum of values
+  double *max;    // maximum of values
+  double *mean_t; // mean of times
+  double *m2_t;   // sum of squared deviations of times
+  double *cov;    // sum of products of deviations of times and values
+} series_t;
+
 void covar_recurrence(double   x, double   y, double *mx, double *my, double *vx, double *vy, double *cv, double n);
 void cov_recurrence(double   x, double   y, double *mx, double *my, double *cv, double n);
 void kurt_recurrence(double   x,    double *mx, double *vx,    double *sx,double *kx, double n);
@@ -57,6 +86,14 @@ void linreg_coefs(double mx, double my, double cov, double varx, double *slope,
 void linreg_r(double cov, double varx, double vary, double *r);
 void linreg_rsquared(double cov, double varx, double vary, double *rsq);
 void linreg_predict(double x, double slope, double intercept, double *y);
+void init_moments(moments_t *moments);
+void merge_moments(moments_t *moments, const moments_t *other);
+void update_moments(moments_t *moments, const double *x, size_t n, size_t stride);
+void update_moments_float(moments_t *moments, const float *x, size_t n);
+series_t allocate_series(int n);
+void reset_series(series_t *series);
+void update_series(series_t *series, int offset, int n, const float *x, double t, float nodata);
+void free_series(series_t *series);
 
 
 #ifdef __cplusplus
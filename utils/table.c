@@ -41,195 +41,515 @@ int num_decimal_places(int i){
 }
 
 
+// powers of ten that are exact in double precision
+static const double table_pow10[23] = { 
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+
+/** Test for a column separator
+--- c:      character
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static inline bool table_separator(char c){
+
+  return c == ' ' || c == ',' || c == '\t' || c == '\r';
+}
+
+
+/** This function parses a number, like atof. Decimal numbers with up to 
++++ 19 significant digits are parsed directly if their value can be formed
++++ with one exact multiplication or division by a power of ten, which 
++++ gives the correctly rounded result. Everything else, e.g. nan, inf, or
++++ long mantissas, is left to strtod.
+--- str:    start of number
+--- end:    end of number (exclusive)
++++ Return: value
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static double table_parse(const char *str, const char *end){
+const char *p = str;
+uint64_t mantissa = 0;
+int ndigit = 0, nsignificant = 0, exponent = 0, e = 0;
+bool negative = false, negative_e = false;
+char buffer[NPOW_08];
+size_t length;
+
+
+  if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++, ndigit++){
+    if (mantissa > 0 || *p != '0') nsignificant++;
+    mantissa = mantissa*10 + (*p - '0');
+  }
+
+  if (p < end && *p == '.'){
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++, ndigit++){
+      if (mantissa > 0 || *p != '0') nsignificant++;
+      mantissa = mantissa*10 + (*p - '0');
+      exponent--;
+    }
+  }
+
+  if (ndigit > 0 && p < end && (*p == 'e' || *p == 'E')){
+    p++;
+    if (p < end && (*p == '-' || *p == '+')) negative_e = (*p++ == '-');
+    for (; p < end && *p >= '0' && *p <= '9'; p++) if (e < NPOW_14) e = e*10 + (*p - '0');
+    exponent += negative_e ? -e : e;
+  }
+
+  if (p == end && ndigit > 0 && nsignificant <= 19 && 
+      mantissa <= ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22){
+    double value = (double)mantissa;
+    value = (exponent < 0) ? value / table_pow10[-exponent] : value * table_pow10[exponent];
+    return negative ? -value : value;
+  }
+
+
+  // the token is not terminated in the file, so it is copied
+  if ((length = end - str) >= NPOW_08) length = NPOW_08-1;
+  memcpy(buffer, str, length);
+  buffer[length] = '\0';
+
+  return strtod(buffer, NULL);
+}
+
+
+/** This function splits one line of a table into its items
++++ Consecutive separators count as one, as with strtok.
+--- line:   start of line
+--- end:    end of line (exclusive)
+--- items:  start and end of each item (returned), or NULL to only count
+--- nmax:   maximum number of items that are returned
++++ Return: number of items in the line
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static int table_items(const char *line, const char *end, const char **items, int nmax){
+const char *p = line;
+int n = 0;
+
+
+  while (p < end){
+
+    while (p < end && table_separator(*p)) p++;
+    if (p == end) break;
+
+    if (items != NULL && n < nmax) items[2*n] = p;
+    while (p < end && !table_separator(*p)) p++;
+    if (items != NULL && n < nmax) items[2*n+1] = p;
+
+    n++;
+
+  }
+
+  return n;
+}
+
+
+/** This function copies an item into a name buffer
+--- dst:    name buffer of size NPOW_10
+--- src:    start of item
+--- end:    end of item (exclusive)
+--- fname:  table file, for error message
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void table_name(char *dst, const char *src, const char *end, const char *fname){
+size_t length = end - src;
+
+  if (length >= NPOW_10){
+    printf("unable to read table %s. name too long.\n", fname);
+    exit(FAILURE);
+  }
+
+  memcpy(dst, src, length);
+  dst[length] = '\0';
+
+  return;
+}
+
+
+/** Number of floats between aligned columns
+--- nrow:   number of rows
++++ Return: column stride
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static size_t table_column_stride(int nrow){
+size_t n = ALLOC_ALIGN / sizeof(float);
+
+  return (nrow + n - 1) / n * n;
+}
+
+
+/** This function allocates the contiguous row-major storage of a table,
++++ and points the rows into it.
+--- table:  table with dimensions
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void table_data(table_t *table){
+int row;
+
+  alloc_aligned((void**)&table->block, (size_t)table->nrow*table->ncol, sizeof(double));
+  alloc((void**)&table->data, table->nrow, sizeof(double*));
+
+  for (row=0; row<table->nrow; row++) table->data[row] = table->block + (size_t)row*table->ncol;
+
+  return;
+}
+
+
+/** This function allocates row and column names of a table
+--- table:         table with dimensions
+--- has_row_names: Has the table row    names? true/false
+--- has_col_names: Has the table column names? true/false
++++ Return:        void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void table_names(table_t *table, bool has_row_names, bool has_col_names){
+
+  if ((table->has_row_names = has_row_names)){
+    alloc_2D((void***)&table->row_names, table->nrow, NPOW_10, sizeof(char));
+  } else {
+    table->row_names = NULL;
+  }
+
+  if ((table->has_col_names = has_col_names)){
+    alloc_2D((void***)&table->col_names, table->ncol, NPOW_10, sizeof(char));
+  } else {
+    table->col_names = NULL;
+  }
+
+  return;
+}
+
+
+/** This function allocates the row and column masks of a table, with 
++++ all rows and columns active, and the column statistics
+--- table:  table with dimensions
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static void table_masks(table_t *table){
+
+  alloc((void**)&table->row_mask, table->nrow, sizeof(bool));
+  memset(table->row_mask, 1, table->nrow);
+  table->n_active_rows = table->nrow;
+
+  alloc((void**)&table->col_mask, table->ncol, sizeof(bool));
+  memset(table->col_mask, 1, table->ncol);
+  table->n_active_cols = table->ncol;
+
+  alloc((void**)&table->mean, table->ncol, sizeof(double));
+  alloc((void**)&table->sd,   table->ncol, sizeof(double));
+  alloc((void**)&table->min,  table->ncol, sizeof(double));
+  alloc((void**)&table->max,  table->ncol, sizeof(double));
+  alloc((void**)&table->sum,  table->ncol, sizeof(double));
+
+  return;
+}
+
+
 /** This function reads a table.
++++ The file is mapped into memory, and split into chunks at line breaks.
++++ The rows of the chunks are counted, and then parsed in parallel. Lines
++++ can be of any length, empty lines are skipped.
 --- fname:         text file
 --- has_row_names: Has the table row    names? true/false
 --- has_col_names: Has the table column names? true/false
 +++ Return:        table
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 table_t read_table(char *fname, bool has_row_names, bool has_col_names){
-FILE *fp;
 table_t table;
-char  buffer[NPOW_16] = "\0";
-char *ptr = NULL;
-const char *separator = " ,\t";
-int line = 0;
-int row  = 0;
-int col  = 0;
-int nrow_buf = NPOW_00;
-int ncol_buf = NPOW_00;
-double mx, vx, k, sum;
-double minimum, maximum;
+struct stat st;
+int fd;
+const char *map = NULL, *data = NULL, *end = NULL, *eol = NULL;
+const char **items = NULL;
+const char **chunk = NULL;
+int *chunk_row = NULL;
+int nchunk, nitem, chunk_id, col;
+long bad_row = LONG_MAX;
 
 
   // init table to zeros
   init_table(&table);
+  table.has_row_names = has_row_names;
+  table.has_col_names = has_col_names;
 
-  // allocate table data
-  alloc_2D((void***)&table.data, nrow_buf, ncol_buf, sizeof(double));
 
-  // allocate row names
-  if ((table.has_row_names = has_row_names)){
-    alloc_2D((void***)&table.row_names, nrow_buf, NPOW_10, sizeof(char));
-  } else {
-    table.row_names = NULL;
+  // map file
+  if ((fd = open(fname, O_RDONLY)) < 0 || fstat(fd, &st) != 0){
+    printf("unable to open table %s\n", fname); 
+    exit(FAILURE);
   }
 
-  // allocate column names
-  if ((table.has_col_names = has_col_names)){
-    alloc_2D((void***)&table.col_names, ncol_buf, NPOW_10, sizeof(char));
-  } else {
-    table.col_names = NULL;
+  if (st.st_size == 0){
+    printf("unable to read table %s. empty file.\n", fname);
+    exit(FAILURE);
+  }
+
+  if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED){
+    printf("unable to map table %s\n", fname); 
+    exit(FAILURE);
   }
 
+  close(fd);
 
-  // open file
-  if (!(fp = fopen(fname, "r"))){
-    printf("unable to open table %s\n", fname); 
+  end = map + st.st_size;
+  data = map;
+
+
+  // skip empty lines before the first line
+  while (data < end){
+    if ((eol = memchr(data, '\n', end - data)) == NULL) eol = end;
+    if (table_items(data, eol, NULL, 0) > 0) break;
+    data = (eol < end) ? eol+1 : end;
+  }
+
+  if (data == end){
+    printf("unable to read table %s. empty file.\n", fname);
     exit(FAILURE);
   }
 
-    
-  // read line by line
-  while (fgets(buffer, NPOW_16, fp) != NULL){
-    
-    buffer[strcspn(buffer, "\r\n")] = 0;
+  // number of cols in 1st line, without row name
+  nitem = table_items(data, eol, NULL, 0);
+  table.ncol = nitem - (has_row_names ? 1 : 0);
 
-    ptr = strtok(buffer, separator);
-    col = 0;
+  if (table.ncol < 1){
+    printf("unable to read table %s. malformed %s.\n", fname, has_col_names ? "col_names" : "row_names");
+    exit(FAILURE);
+  }
 
-    // parse one line
-    while (ptr != NULL){
+  alloc((void**)&items, 2*nitem, sizeof(char*));
 
-      // parse column names
-      if (row == 0 && has_col_names && table.ncol == 0){
+  // parse column names, skip 1st item if there are row names
+  if (has_col_names){
 
-        // skip 1st item if there are row names
-        // if there is no other item after, exit with error
-        if (has_row_names && col == 0){
-          if ((ptr = strtok(NULL, separator)) == NULL){
-            printf("unable to read table %s. malformed col_names.\n", fname);
-            exit(FAILURE);
-          }
-        }
+    alloc_2D((void***)&table.col_names, table.ncol, NPOW_10, sizeof(char));
 
-        copy_string(table.col_names[col], NPOW_10, ptr);
-        ptr = strtok(NULL, separator);
-        col++;
+    table_items(data, eol, items, nitem);
+    for (col=0; col<table.ncol; col++){
+      table_name(table.col_names[col], items[2*(col+nitem-table.ncol)], items[2*(col+nitem-table.ncol)+1], fname);
+    }
 
-        // if too many cols, add twice of previous cols to buffer
-        if (col >= ncol_buf){
-          re_alloc_2D((void***)&table.col_names, ncol_buf, NPOW_10, ncol_buf*2, NPOW_10, sizeof(char));
-          re_alloc_2D((void***)&table.data, nrow_buf, ncol_buf, nrow_buf, ncol_buf*2, sizeof(double));
-          ncol_buf *= 2;
-        }
+    data = (eol < end) ? eol+1 : end;
 
-      } else {
+  }
+
+  free((void*)items);
+
+
+  // chunks of about 1 MB, starting at line breaks
+  nchunk = (end - data) / NPOW_10 / NPOW_10 + 1;
+
+  alloc((void**)&chunk,     nchunk+1, sizeof(char*));
+  alloc((void**)&chunk_row, nchunk+1, sizeof(int));
+
+  chunk[0] = data;
+  chunk[nchunk] = end;
+
+  for (chunk_id=1; chunk_id<nchunk; chunk_id++){
+    const char *p = data + (end - data) / nchunk * chunk_id;
+    if (p < chunk[chunk_id-1]) p = chunk[chunk_id-1];
+    if ((eol = memchr(p, '\n', end - p)) == NULL) eol = end;
+    chunk[chunk_id] = (eol < end) ? eol+1 : end;
+  }
+
+
+  // count the rows of each chunk
+  #pragma omp parallel for schedule(dynamic)
+  for (chunk_id=0; chunk_id<nchunk; chunk_id++){
+
+    const char *p = chunk[chunk_id], *q;
+    int n = 0;
+
+    while (p < chunk[chunk_id+1]){
+      if ((q = memchr(p, '\n', chunk[chunk_id+1] - p)) == NULL) q = chunk[chunk_id+1];
+      if (table_items(p, q, NULL, 0) > 0) n++;
+      p = q+1;
+    }
+
+    chunk_row[chunk_id+1] = n;
+
+  }
+
+  for (chunk_id=0; chunk_id<nchunk; chunk_id++) chunk_row[chunk_id+1] += chunk_row[chunk_id];
+  table.nrow = chunk_row[nchunk];
+
+  if (table.nrow < 1){
+    printf("unable to read table %s. no rows.\n", fname);
+    exit(FAILURE);
+  }
+
+
+  // allocate table data and row names
+  table_data(&table);
+  if (has_row_names) alloc_2D((void***)&table.row_names, table.nrow, NPOW_10, sizeof(char));
 
-        // parse row name
-        // if there is no other item after, exit with error
-        if (has_row_names && col == 0){
-          copy_string(table.row_names[row], NPOW_10, ptr);
-          if ((ptr = strtok(NULL, separator)) == NULL){
-            printf("unable to read table %s. malformed row_names.\n", fname);
-            exit(FAILURE);
-          }
+
+  // parse the rows of each chunk
+  #pragma omp parallel for schedule(dynamic) reduction(min: bad_row)
+  for (chunk_id=0; chunk_id<nchunk; chunk_id++){
+
+    const char *p = chunk[chunk_id], *q;
+    const char **item = NULL;
+    int r = chunk_row[chunk_id], n, c;
+
+    alloc((void**)&item, 2*nitem, sizeof(char*));
+
+    while (p < chunk[chunk_id+1]){
+
+      if ((q = memchr(p, '\n', chunk[chunk_id+1] - p)) == NULL) q = chunk[chunk_id+1];
+
+      if ((n = table_items(p, q, item, nitem)) > 0){
+
+        // table is regular?
+        if (n != nitem){
+          if (r+1 < bad_row) bad_row = r+1;
+          break;
         }
 
-        table.data[row][col] = atof(ptr); 
-        ptr = strtok(NULL, separator);
-        col++;
+        if (has_row_names) table_name(table.row_names[r], item[0], item[1], fname);
 
-        // if too many cols, add twice of previous cols to buffer
-        if (col >= ncol_buf){
-          if (has_col_names) re_alloc_2D((void***)&table.col_names, ncol_buf, NPOW_10, ncol_buf*2, NPOW_10, sizeof(char));
-          re_alloc_2D((void***)&table.data, nrow_buf, ncol_buf, nrow_buf, ncol_buf*2, sizeof(double));
-          ncol_buf *= 2;
+        for (c=0; c<table.ncol; c++){
+          table.data[r][c] = table_parse(item[2*(c+nitem-table.ncol)], item[2*(c+nitem-table.ncol)+1]);
         }
 
-      }
+        r++;
 
-    }
+      }
 
-    // number of cols in 1st row
-    if (row == 0) table.ncol = col;
-    if (!has_col_names || line > 0) row++;
+      p = q+1;
 
-    // table is regular?
-    if (row > 0 && col != table.ncol){
-      printf("unable to read table %s. Different number of cols found in line %d\n", fname, row); 
-      exit(FAILURE);
     }
 
-    // if too many rows, add twice of previous rows to buffer
-    if (row >= (int)nrow_buf){
-      re_alloc_2D((void***)&table.data, nrow_buf, ncol_buf, nrow_buf*2, ncol_buf, sizeof(double));
-      if (has_row_names) re_alloc_2D((void***)&table.row_names, nrow_buf, NPOW_10, nrow_buf*2, NPOW_10, sizeof(char));
-      nrow_buf *= 2;
-    }
+    free((void*)item);
 
-    line++;
+  }
 
+  munmap((void*)map, st.st_size);
+  free((void*)chunk);
+  free((void*)chunk_row);
+
+  if (bad_row < LONG_MAX){
+    printf("unable to read table %s. Different number of cols found in row %ld\n", fname, bad_row); 
+    exit(FAILURE);
   }
 
-  table.nrow = row;
-  fclose(fp);
 
-  
-  // re-shape buffer to actual dimensions, 1st rows, then cols
-  if (table.nrow != nrow_buf || table.ncol != ncol_buf){
-    re_alloc_2D((void***)&table.data, nrow_buf,   ncol_buf, table.nrow, ncol_buf,   sizeof(double));
-    re_alloc_2D((void***)&table.data, table.nrow, ncol_buf, table.nrow, table.ncol, sizeof(double));
-    if (has_row_names) re_alloc_2D((void***)&table.row_names, nrow_buf, NPOW_10, table.nrow, NPOW_10, sizeof(char));
-    if (has_col_names) re_alloc_2D((void***)&table.col_names, ncol_buf, NPOW_10, table.ncol, NPOW_10, sizeof(char));
+  table_masks(&table);
+  table_stats(&table);
+
+
+  return table;
+}
+
+
+/** This function opens a table for reading in chunks of rows. This is 
++++ meant for tables that do not fit into memory. The first data line is
++++ read to determine the number of columns.
+--- fname:         text file
+--- has_row_names: Has the table row    names? true/false
+--- has_col_names: Has the table column names? true/false
++++ Return:        table stream
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+table_stream_t open_table_stream(char *fname, bool has_row_names, bool has_col_names){
+table_stream_t stream;
+ssize_t length;
+
+
+  copy_string(stream.fname, STRLEN, fname);
+  stream.has_row_names = has_row_names;
+  stream.ncol = 0;
+  stream.nrow = 0;
+  stream.pending = false;
+  stream.buffer = NULL;
+  stream.size = 0;
+  stream.length = 0;
+
+  if (!(stream.fp = fopen(fname, "r"))){
+    printf("unable to open table %s\n", fname); 
+    exit(FAILURE);
   }
 
-  alloc((void**)&table.row_mask, table.nrow, sizeof(bool));
-  memset(table.row_mask, 1, table.nrow);
-  table.n_active_rows = table.nrow;
+  // skip column names
+  if (has_col_names && getline(&stream.buffer, &stream.size, stream.fp) < 0){
+    printf("unable to read table %s. no col_names.\n", fname);
+    exit(FAILURE);
+  }
 
-  alloc((void**)&table.col_mask, table.ncol, sizeof(bool));
-  memset(table.col_mask, 1, table.ncol);
-  table.n_active_cols = table.ncol;
+  if ((length = getline(&stream.buffer, &stream.size, stream.fp)) < 0) return stream;
 
+  stream.length = length;
+  stream.pending = true;
 
-  alloc((void**)&table.mean, table.ncol, sizeof(double));
-  alloc((void**)&table.sd,   table.ncol, sizeof(double));
-  alloc((void**)&table.min,  table.ncol, sizeof(double));
-  alloc((void**)&table.max,  table.ncol, sizeof(double));
-  alloc((void**)&table.sum,  table.ncol, sizeof(double));
+  stream.ncol = table_items(stream.buffer, stream.buffer + stream.length, NULL, 0);
+  if (has_row_names) stream.ncol--;
 
-  for (col=0; col<table.ncol; col++){
+  return stream;
+}
 
-    mx = vx = k = sum = 0;
-    minimum = SHRT_MAX; maximum = SHRT_MIN;
 
-    for (row=0; row<table.nrow; row++){
+/** This function reads the next chunk of rows from a table stream into 
++++ a row-major float buffer.
+--- stream: table stream
+--- data:   buffer, nrow x ncol
+--- nrow:   maximum number of rows to read
++++ Return: number of rows read, 0 at end of file
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int read_table_chunk(table_stream_t *stream, float *data, int nrow){
+const char **items = NULL;
+int nitem = stream->ncol + (stream->has_row_names ? 1 : 0);
+int row = 0, col, n;
+ssize_t length;
 
-      k++;
-      if (k == 1){
-        mx = table.data[row][col];
-      } else {
-        var_recurrence(table.data[row][col], &mx, &vx, k);
-      }
 
-      if (table.data[row][col] < minimum) minimum = table.data[row][col];
-      if (table.data[row][col] > maximum) maximum = table.data[row][col];
+  alloc((void**)&items, 2*nitem, sizeof(char*));
 
-      sum += table.data[row][col];
+  while (row < nrow){
 
+    if (!stream->pending){
+      if ((length = getline(&stream->buffer, &stream->size, stream->fp)) < 0) break;
+      stream->length = length;
     }
- 
-    table.mean[col] = mx;
-    table.sd[col]   = standdev(vx, k);
-    table.min[col]  = minimum;
-    table.max[col]  = maximum;
-    table.sum[col]  = sum;
+    stream->pending = false;
+
+    n = table_items(stream->buffer, stream->buffer + stream->length, items, nitem);
+    if (n == 0) continue; // empty line
+
+    if (n != nitem){
+      printf("unable to read table %s. Different number of cols found in line %ld\n", 
+        stream->fname, stream->nrow+row+1); 
+      exit(FAILURE);
+    }
+
+    // skip row name
+    for (col=0; col<stream->ncol; col++){
+      data[(size_t)row*stream->ncol+col] = table_parse(items[2*(col+nitem-stream->ncol)], items[2*(col+nitem-stream->ncol)+1]);
+    }
+
+    row++;
 
   }
 
+  free((void*)items);
 
-  return table;
+  stream->nrow += row;
+
+  return row;
+}
+
+
+/** This function closes a table stream
+--- stream: table stream
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void close_table_stream(table_stream_t *stream){
+
+  if (stream->fp != NULL){
+    fclose(stream->fp);
+    stream->fp = NULL;
+  }
+
+  if (stream->buffer != NULL){
+    free((void*)stream->buffer);
+    stream->buffer = NULL;
+  }
+
+  return;
 }
 
 
@@ -246,6 +566,9 @@ void init_table(table_t *table){
   table->row_names = NULL;
   table->col_names = NULL;
   table->data = NULL;
+  table->block = NULL;
+  table->columns = NULL;
+  table->column_block = NULL;
   table->row_mask = NULL;
   table->col_mask = NULL;
   table->n_active_cols = 0;
@@ -271,43 +594,215 @@ table_t allocate_table(int nrow, int ncol, bool has_row_names, bool has_col_name
 table_t table;
 
 
+  init_table(&table);
+
   table.nrow = nrow;
   table.ncol = ncol;
 
   // allocate table data
-  alloc_2D((void***)&table.data, table.nrow, table.ncol, sizeof(double));
+  table_data(&table);
 
-  // allocate row names
-  if ((table.has_row_names = has_row_names)){
-    alloc_2D((void***)&table.row_names, table.nrow, NPOW_10, sizeof(char));
-  } else {
-    table.row_names = NULL;
+  table_names(&table, has_row_names, has_col_names);
+  table_masks(&table);
+
+  return table;
+}
+
+
+/** This function allocates an empty float32 table. The columns are 
++++ stored contiguously, and each column starts at an aligned address.
++++ There is no row-major view, use table_get or the columns.
+--- nrow:          number of rows
+--- ncol:          number of columns
+--- has_row_names: Has the table row    names? true/false
+--- has_col_names: Has the table column names? true/false
++++ Return:        table
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+table_t allocate_table_float(int nrow, int ncol, bool has_row_names, bool has_col_names){
+table_t table;
+
+
+  init_table(&table);
+
+  table.nrow = nrow;
+  table.ncol = ncol;
+
+  table_columns(&table);
+
+  table_names(&table, has_row_names, has_col_names);
+  table_masks(&table);
+
+  return table;
+}
+
+
+/** This function wraps float32 columns in external memory, e.g. of a 
++++ mapped file, as a table. The columns are not copied, and need to
++++ outlive the table. Column statistics are not computed.
+--- nrow:   number of rows
+--- ncol:   number of columns
+--- base:   first column
+--- stride: distance between columns in bytes
++++ Return: table
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+table_t view_table_columns(int nrow, int ncol, const float *base, size_t stride){
+table_t table;
+int col;
+
+
+  init_table(&table);
+
+  table.nrow = nrow;
+  table.ncol = ncol;
+
+  alloc((void**)&table.columns, ncol, sizeof(float*));
+  for (col=0; col<ncol; col++) table.columns[col] = (float*)((const char*)base + col*stride);
+
+  table_masks(&table);
+
+  return table;
+}
+
+
+/** This function returns the float32 column view of a table. Only views
++++ of float32 columns, e.g. of a compiled LUT, are returned without copy.
++++ For tables with double storage, as read from csv, the columns are 
++++ copied once into aligned float32 storage, and kept with the table.
++++ Changes to data after this call are not reflected in the columns.
+--- table:  table
++++ Return: columns
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float **table_columns(table_t *table){
+size_t stride = table_column_stride(table->nrow);
+int row, col;
+
+
+  if (table->columns != NULL) return table->columns;
+
+  alloc_aligned((void**)&table->column_block, stride*table->ncol, sizeof(float));
+  alloc((void**)&table->columns, table->ncol, sizeof(float*));
+
+  for (col=0; col<table->ncol; col++){
+    table->columns[col] = table->column_block + stride*col;
+    if (table->data == NULL) continue;
+    for (row=0; row<table->nrow; row++) table->columns[col][row] = table->data[row][col];
   }
 
-  // allocate column names
-  if ((table.has_col_names = has_col_names)){
-    alloc_2D((void***)&table.col_names, table.ncol, NPOW_10, sizeof(char));
-  } else {
-    table.col_names = NULL;
+  return table->columns;
+}
+
+
+/** This function copies the active rows and columns of a table, as 
++++ given by the row and column masks, into a new table with double 
++++ storage. Names are copied, and the column statistics are computed.
+--- table:  table
++++ Return: compacted table, with all rows and columns active
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+table_t compact_table(table_t *table){
+table_t compact;
+int *rows = NULL, *cols = NULL;
+int nrow = 0, ncol = 0;
+int row, col;
+
+
+  alloc((void**)&rows, table->nrow, sizeof(int));
+  alloc((void**)&cols, table->ncol, sizeof(int));
+
+  for (row=0; row<table->nrow; row++){
+    if (table->row_mask[row]) rows[nrow++] = row;
   }
 
+  for (col=0; col<table->ncol; col++){
+    if (table->col_mask[col]) cols[ncol++] = col;
+  }
 
-  alloc((void**)&table.row_mask, table.nrow, sizeof(bool));
-  memset(table.row_mask, 1, table.nrow);
-  table.n_active_rows = table.nrow;
+  compact = allocate_table(nrow, ncol, table->has_row_names, table->has_col_names);
 
-  alloc((void**)&table.col_mask, table.ncol, sizeof(bool));
-  memset(table.col_mask, 1, table.ncol);
-  table.n_active_cols = table.ncol;
+  #pragma omp parallel for private(col) schedule(static)
+  for (row=0; row<nrow; row++){
+    for (col=0; col<ncol; col++) compact.data[row][col] = table_get(table, rows[row], cols[col]);
+  }
 
+  if (table->has_row_names){
+    for (row=0; row<nrow; row++) copy_string(compact.row_names[row], NPOW_10, table->row_names[rows[row]]);
+  }
 
-  alloc((void**)&table.mean, table.ncol, sizeof(double));
-  alloc((void**)&table.sd,   table.ncol, sizeof(double));
-  alloc((void**)&table.min,  table.ncol, sizeof(double));
-  alloc((void**)&table.max,  table.ncol, sizeof(double));
-  alloc((void**)&table.sum,  table.ncol, sizeof(double));
+  if (table->has_col_names){
+    for (col=0; col<ncol; col++) copy_string(compact.col_names[col], NPOW_10, table->col_names[cols[col]]);
+  }
 
-  return table;
+  table_stats(&compact);
+
+  free((void*)rows);
+  free((void*)cols);
+
+  return compact;
+}
+
+
+/** This function computes the column statistics of a table. The rows
++++ are split into chunks that are summarized in parallel, and the chunks
++++ are merged in order, so that the result does not depend on the number
++++ of threads.
+--- table:  table
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void table_stats(table_t *table){
+moments_t *moments = NULL;
+int nchunk, col, chunk;
+
+
+  if (table->mean == NULL) alloc((void**)&table->mean, table->ncol, sizeof(double));
+  if (table->sd   == NULL) alloc((void**)&table->sd,   table->ncol, sizeof(double));
+  if (table->min  == NULL) alloc((void**)&table->min,  table->ncol, sizeof(double));
+  if (table->max  == NULL) alloc((void**)&table->max,  table->ncol, sizeof(double));
+  if (table->sum  == NULL) alloc((void**)&table->sum,  table->ncol, sizeof(double));
+
+  if (table->ncol < 1) return;
+
+  nchunk = (table->nrow + TABLE_STATS_CHUNK - 1) / TABLE_STATS_CHUNK;
+  if (nchunk < 1) nchunk = 1;
+
+  alloc((void**)&moments, (size_t)table->ncol*nchunk, sizeof(moments_t));
+
+  #pragma omp parallel for collapse(2) schedule(dynamic)
+  for (col=0; col<table->ncol; col++){
+    for (chunk=0; chunk<nchunk; chunk++){
+
+      moments_t *m = moments + (size_t)col*nchunk + chunk;
+      int row = chunk*TABLE_STATS_CHUNK;
+      int n = (table->nrow-row < TABLE_STATS_CHUNK) ? table->nrow-row : TABLE_STATS_CHUNK;
+
+      init_moments(m);
+
+      if (n < 1) continue;
+
+      if (table->data != NULL){
+        update_moments(m, table->data[row] + col, n, table->ncol);
+      } else {
+        update_moments_float(m, table->columns[col] + row, n);
+      }
+
+    }
+  }
+
+  for (col=0; col<table->ncol; col++){
+
+    moments_t *m = moments + (size_t)col*nchunk;
+
+    for (chunk=1; chunk<nchunk; chunk++) merge_moments(m, m + chunk);
+ 
+    table->mean[col] = m->mean;
+    table->sd[col]   = standdev(m->m2, m->n);
+    table->min[col]  = m->min;
+    table->max[col]  = m->max;
+    table->sum[col]  = m->sum;
+
+  }
+
+  free((void*)moments);
+
+  return;
 }
 
 
@@ -377,7 +872,7 @@ int width, *max_width = NULL;
     }
 
     for (row=0; row<table->nrow; row++){
-        width = num_decimal_places((int)table->data[row][col]) + 4; // + 2 decimal digits, + decimal point, + sign
+        width = num_decimal_places((int)table_get(table, row, col)) + 4; // + 2 decimal digits, + decimal point, + sign
         if (width > max_width[col+1]) max_width[col+1] = width;
     }
 
@@ -399,7 +894,7 @@ int width, *max_width = NULL;
     if (skip_rows && !table->row_mask[row]) continue;
 
     if (table->has_row_names) printf("%*s ", max_width[0], table->row_names[row]);
-    for (col=0; col<ncol_print; col++) printf("%+*.2f ", max_width[col+1], table->data[row][col]);
+    for (col=0; col<ncol_print; col++) printf("%+*.2f ", max_width[col+1], table_get(table, row, col));
     if (truncate && col < table->ncol) printf("...");
     printf("\n");
 
@@ -414,15 +909,67 @@ int width, *max_width = NULL;
 }
 
 
+/** This function formats a number with the fewest significant digits 
++++ that read back to the same double. Numbers in fixed notation are
++++ tried with an increasing number of decimals, each candidate is an 
++++ integer below 2^53, which is divided exactly by a power of ten for 
++++ checking. Other numbers are formatted with printf and checked with
++++ strtod.
+--- value:  number
+--- str:    buffer of NPOW_05 chars
++++ Return: number of chars
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+static int table_format(double value, char *str){
+double a = fabs(value), limit = 9007199254740992.0; // 2^53
+char digits[NPOW_05];
+int precision, ndigit, n = 0, k, i;
+
+
+  for (k=0; a >= 1e-4 && a < limit && k<=22; k++){
+
+    double scaled = a*table_pow10[k];
+    if (scaled >= limit) break;
+
+    uint64_t d = (uint64_t)(scaled + 0.5);
+    if ((double)d / table_pow10[k] != a) continue;
+
+    // digits of d, with at least one digit before the decimal point
+    for (ndigit=0; d > 0 || ndigit <= k; d /= 10) digits[ndigit++] = '0' + d % 10;
+    while (k > 0 && digits[0] == '0'){ memmove(digits, digits+1, --ndigit); k--; }
+
+    if (value < 0) str[n++] = '-';
+    for (i=ndigit-1; i>=0; i--){
+      str[n++] = digits[i];
+      if (i == k && k > 0) str[n++] = '.';
+    }
+    str[n] = '\0';
+
+    return n;
+
+  }
+
+  for (precision=15; precision<=17; precision++){
+    n = snprintf(str, NPOW_05, "%.*g", precision, value);
+    if (strtod(str, NULL) == value) break;
+  }
+
+  return n;
+}
+
+
 /** This function writes a table.
++++ Numbers are written with the shortest representation that reads back
++++ exactly, and lines are collected in a large file buffer.
 --- table:     table
 --- fname:     filename
 --- separator: column separator
+--- skip_rows: skip rows that are masked out? true/false
 +++ Return:    void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void write_table(table_t *table, char *fname, const char *separator, bool skip_rows){
 int row, col;
 FILE *fp = NULL;
+char number[NPOW_05];
 
 
   if ((fp = fopen(fname, "w")) == NULL){
@@ -430,6 +977,8 @@ FILE *fp = NULL;
     exit(FAILURE);
   }
 
+  setvbuf(fp, NULL, _IOFBF, NPOW_10*NPOW_10);
+
  
   if (table->has_col_names){
 
@@ -444,14 +993,23 @@ FILE *fp = NULL;
 
     if (skip_rows && !table->row_mask[row]) continue;
 
-    if (table->has_row_names) fprintf(fp, "%s%s", table->row_names[row], separator);
-    for (col=0; col<(table->ncol-1); col++) fprintf(fp, "%.2f%s", table->data[row][col], separator);
-    fprintf(fp, "%.2f\n", table->data[row][col]);
+    if (table->has_row_names){
+      fputs(table->row_names[row], fp);
+      fputs(separator, fp);
+    }
+
+    for (col=0; col<table->ncol; col++){
+      fwrite(number, 1, table_format(table_get(table, row, col), number), fp);
+      fputs((col < table->ncol-1) ? separator : "\n", fp);
+    }
 
   }
 
 
-  fclose(fp);
+  if (fclose(fp) != 0){
+    printf("unable to write file %s\n", fname); 
+    exit(FAILURE);
+  }
 
   return;
 }
@@ -478,8 +1036,18 @@ void free_table(table_t *table){
   }
 
   if (table->data != NULL){
-    free_2D((void**)table->data, table->nrow);
-    table->data = NULL;
+    free((void*)table->data);
+    free((void*)table->block);
+    table->data  = NULL;
+    table->block = NULL;
+  }
+
+  // columns that are only viewed are not freed
+  if (table->columns != NULL){
+    if (table->column_block != NULL) free((void*)table->column_block);
+    free((void*)table->columns);
+    table->columns = NULL;
+    table->column_block = NULL;
   }
 
   if (table->row_mask != NULL){
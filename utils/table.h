@@ -31,6 +31,13 @@ Handle tables (csv-styled)
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
 #include <stdbool.h> // boolean data type
+#include <float.h>   // floating-point limits
+#include <stdint.h>  // fixed-width integer types
+#include <limits.h>  // integer limits
+#include <fcntl.h>   // file control
+#include <unistd.h>  // POSIX API
+#include <sys/mman.h> // memory mapping
+#include <sys/stat.h> // file status
 
 #include "const.h"
 #include "alloc.h"
@@ -42,6 +49,9 @@ Handle tables (csv-styled)
 extern "C" {
 #endif
 
+// number of rows that are summarized by one thread in table_stats
+#define TABLE_STATS_CHUNK NPOW_16
+
 typedef struct {
   int nrow;
   int ncol;
@@ -49,7 +59,10 @@ typedef struct {
   bool has_col_names;
   char **row_names;
   char **col_names;
-  double **data;
+  double **data;        // row-major view, data[row][col], or NULL for float32 tables
+  double *block;        // contiguous, aligned storage behind data
+  float **columns;      // column-major float32 view, columns[col][row], or NULL
+  float *column_block;  // contiguous, aligned storage behind columns, NULL if not owned
   bool *row_mask;
   bool *col_mask;
   int n_active_cols;
@@ -61,14 +74,39 @@ typedef struct {
   double *sum;
 } table_t;
 
+typedef struct {
+  FILE *fp;
+  char fname[STRLEN];
+  bool has_row_names;
+  int ncol;
+  long nrow;             // number of rows read so far
+  bool pending;          // buffer holds a line that was not parsed yet
+  char *buffer;          // current line, grown as needed
+  size_t size;           // allocated size of buffer
+  size_t length;         // length of current line
+} table_stream_t;
+
 table_t read_table(char *fname, bool has_row_names, bool has_col_names);
 table_t allocate_table(int nrow, int ncol, bool has_row_names, bool has_col_names);
+table_t allocate_table_float(int nrow, int ncol, bool has_row_names, bool has_col_names);
+table_t view_table_columns(int nrow, int ncol, const float *base, size_t stride);
+float **table_columns(table_t *table);
+table_t compact_table(table_t *table);
+void table_stats(table_t *table);
 int find_table_col(table_t *table, const char *name);
 int find_table_row(table_t *table, const char *name);
 void init_table(table_t *table);
 void print_table(table_t *table, bool truncate, bool skip_rows);
 void write_table(table_t *table, char *fname, const char *separator, bool skip_rows);
 void free_table(table_t *table);
+// value of a cell, for tables with either storage
+static inline double table_get(const table_t *table, int row, int col){
+  return (table->data != NULL) ? table->data[row][col] : table->columns[col][row];
+}
+
+table_stream_t open_table_stream(char *fname, bool has_row_names, bool has_col_names);
+int read_table_chunk(table_stream_t *stream, float *data, int nrow);
+void close_table_stream(table_stream_t *stream);
 
 #ifdef __cplusplus
 }